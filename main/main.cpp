@@ -51,6 +51,7 @@ extern "C" {
 // #include "pax_text.h"
 // #include "pax_types.h"
 #include "src/C64Emu.hpp"
+#include "src/EventTrace.hpp"
 // #include "src/konsoolled.hpp"
 // #include "src/Config.hpp"
 // Constants
@@ -112,11 +113,16 @@ extern "C" void app_main(void)
     // Main loop outputs C64 screen contents to the display
     while (true) {
         // Wait for display refresh signal
+        TRACE_BEGIN(DISPLAY, "waitTE");
         xSemaphoreTake(semaphore, 100 / portTICK_PERIOD_MS);
+        TRACE_END(DISPLAY, "waitTE");
 
         // We only want 50Hz output, so we'll skip some frames
         if (to50hz > 1.0) {
+            TRACE_BEGIN(DISPLAY, "refresh");
             c64Emu.loop();
+            TRACE_END(DISPLAY, "refresh");
+            TRACE_INSTANT(DISPLAY, "frameGive");
             xSemaphoreGive(frameRateMutex);
             to50hz -= 1.0;
         }
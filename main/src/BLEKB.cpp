@@ -17,6 +17,7 @@
 #include "BLEKB.h"
 #include <esp_log.h>
 #include <cstring>
+#include <memory>
 #include "C64Emu.h"
 #include "Config.h"
 #include "ExternalCmds.h"
@@ -35,54 +36,40 @@ static const uint8_t VIRTUALJOYSTICKUP_DEACTIVATED    = 0x84;
 static const uint8_t VIRTUALJOYSTICKDOWN_ACTIVATED    = 0x08;
 static const uint8_t VIRTUALJOYSTICKDOWN_DEACTIVATED  = 0x88;
 
-class ExeExtCmdTask {
+// Runs an external command on the CPU task and waits for its result. The BLE task is the only producer of the
+// ExternalCmds mailbox on boards with BLEKB.
+class ExtCmdCall {
    private:
-    TaskHandle_t  exeExtCmdTaskHandle;
+    // shared with the onDone callback, which may run after a timed out wait
+    struct Result {
+        TaskHandle_t waitingTask;
+        uint8_t      type = 0;
+    };
+
     BLEKB&        blekb;
     ExternalCmds& externalCmds;
-    uint8_t       type;
-
-    static void exeExternalCmd(void* parameter) {
-        ExeExtCmdTask* instance = static_cast<ExeExtCmdTask*>(parameter);
-        instance->type          = instance->externalCmds.executeExternalCmd(instance->blekb.buffer);
-        // signal that task is done using a task notification
-        BaseType_t notifyResult = xTaskNotifyGive(instance->exeExtCmdTaskHandle);
-        if (notifyResult == pdPASS) {
-            ESP_LOGD(TAG, "Notification sent successfully");
-        } else {
-            ESP_LOGD(TAG, "Failed to send notification");
-        }
-        // delete task
-        vTaskDelete(NULL);
-    }
 
    public:
-    ExeExtCmdTask(BLEKB& blekb, ExternalCmds& externalCmds)
-        : exeExtCmdTaskHandle(NULL), blekb(blekb), externalCmds(externalCmds) {
+    ExtCmdCall(BLEKB& blekb, ExternalCmds& externalCmds) : blekb(blekb), externalCmds(externalCmds) {
     }
 
-    uint8_t exe() {
-        exeExtCmdTaskHandle = xTaskGetCurrentTaskHandle();
-        xTaskCreate(ExeExtCmdTask::exeExternalCmd,  // Task function
-                    "externalCmdTask",              // Name of the task
-                    10000,                          // Stack size (in words)
-                    this,                           // Task input parameter
-                    1,                              // Priority of the task
-                    NULL                            // Task handle
-        );
-        // wait for task to be completed
-        uint32_t   ulNotificationValue;
-        BaseType_t result = xTaskNotifyWait(0x00,                  // No bits to clear on entry
-                                            ULONG_MAX,             // Clear all bits on exit
-                                            &ulNotificationValue,  // Where to store the notification value
-                                            pdMS_TO_TICKS(5000)    // Wait max 5 seconds
-        );
-        if (result == pdPASS) {
-            // Return the stored return value
-            ESP_LOGD(TAG, "task completed, type = %d", type);
-            return type;
+    uint8_t exe(uint8_t len) {
+        std::shared_ptr<Result> result = std::make_shared<Result>();
+        result->waitingTask            = xTaskGetCurrentTaskHandle();
+        bool posted = externalCmds.postExternalCmd(blekb.buffer, len, [result](uint8_t type) {
+            result->type = type;
+            xTaskNotifyGive(result->waitingTask);
+        });
+        if (!posted) {
+            ESP_LOGD(TAG, "external command mailbox full");
+            return 0;
+        }
+        // wait for the CPU task to execute the command at the end of the frame
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(5000)) != 0) {
+            ESP_LOGD(TAG, "command completed, type = %d", result->type);
+            return result->type;
         } else {
-            ESP_LOGD(TAG, "failed to send notification or timed out");
+            ESP_LOGD(TAG, "command timed out");
             return 0;
         }
     }
@@ -154,12 +141,10 @@ void BLEKBCharacteristicCallback::onWrite(BLECharacteristic* pCharacteristic) {
         blekb.keypresseddown    = true;
         // external command?
         if (blekb.shiftctrlcode & 128) {
-            // execute external command
-            // have to use a seperate task, because stack size of the BLE processing
-            // task is too small (and task size is not changeable under Arduino)
+            // execute external command on the CPU task, the notification data is ready when it is done
             ESP_LOGI(TAG, "run external command...");
-            ExeExtCmdTask exeExtCmdTask(blekb, externalCmds);
-            uint8_t       type = exeExtCmdTask.exe();
+            ExtCmdCall    extCmdCall(blekb, externalCmds);
+            uint8_t       type = extCmdCall.exe(len);
             // send notification
             switch (type) {
                 case 1:
@@ -19,7 +19,9 @@
 #include <string.h>
 #include <cstdint>
 // #include "Config.hpp"
+#include "EventTrace.hpp"
 #include "ExternalCmds.hpp"
+#include "Profiler.hpp"
 // #include "HardwareInitializationException.h"
 #include "VIC.hpp"
 // #include "driver/timer_types_legacy.h"
@@ -50,110 +52,49 @@ C64Emu* C64Emu::instance = nullptr;
 
 void IRAM_ATTR C64Emu::interruptProfilingBatteryCheckFunc()
 {
+    TRACE_SCOPE(TIMER, "profiling");
     // Retrieve the battery voltage
     bsp_battery_get_voltage((uint16_t*)&batteryVoltage);
 
+#if defined(USE_PROFILER)
+    // subsystem cycle costs, also needed for the HUD
+    Profiler::report(vic.cntRefreshs, perf);
+#endif
+
+    // number of cycles per second, taken in one step so no cycles of the CPU task are lost
+    uint32_t cycles = cpu.numofcyclespersecond.exchange(0, std::memory_order_relaxed);
+
     // profiling (if activated)
     if (!perf) {
+        vic.cntRefreshs = 0;
         return;
     }
     // frames per second
     if (vic.cntRefreshs != 0) {
-        ESP_LOGI(TAG, "fps: %d batv: %d", vic.cntRefreshs, (int)batteryVoltage);
+        ESP_LOGI(TAG, "fps: %d cycles: %d batv: %d", vic.cntRefreshs, (int)cycles, (int)batteryVoltage);
     }
-    vic.cntRefreshs            = 0;
-    // number of cycles per second
-    cpu.numofcyclespersecond   = 0;
-    numofburnedcyclespersecond = 0;
-}
-
-bool C64Emu::updateTOD(CIA& cia)
-{
-    uint8_t dc08 = cia.latchRunDC08.load(std::memory_order_acquire);
-    dc08++;
-    if (dc08 > 9) {
-        dc08            = 0;
-        uint8_t dc09    = cia.latchRunDC09.load(std::memory_order_acquire);
-        uint8_t dc09one = dc09 & 15;
-        uint8_t dc09ten = dc09 >> 4;
-        dc09one++;
-        if (dc09one > 9) {
-            dc09one = 0;
-            dc09ten++;
-            if (dc09ten > 5) {
-                dc09ten         = 0;
-                uint8_t dc0a    = cia.latchRunDC0A.load(std::memory_order_acquire);
-                uint8_t dc0aone = dc0a & 15;
-                uint8_t dc0aten = dc0a >> 4;
-                dc0aone++;
-                if (dc0aone > 9) {
-                    dc0aone = 0;
-                    dc0aten++;
-                    if (dc0aten > 5) {
-                        dc0aten         = 0;
-                        uint8_t dc0b    = cia.latchRunDC0B.load(std::memory_order_acquire);
-                        uint8_t dc0bone = dc0b & 15;
-                        uint8_t dc0bten = dc0b >> 4;
-                        bool    pm      = dc0b & 128;
-                        dc0bone++;
-                        if (((dc0bten == 0) && (dc0bone > 9)) || (dc0bten && (dc0bone > 1))) {
-                            dc0bone = 0;
-                            dc0bten++;
-                            if (dc0bten > 1) {
-                                dc0bten = 0;
-                                pm      = !pm;
-                            }
-                        }
-                        cia.latchRunDC0B.store(dc0bone | (dc0bten << 4) | (pm ? 127 : 0), std::memory_order_release);
-                    }
-                }
-                cia.latchRunDC0A.store(dc0aone | (dc0aten << 4), std::memory_order_release);
-            }
-        }
-        cia.latchRunDC09.store(dc09one | (dc09ten << 4), std::memory_order_release);
+    // input latencies
+    uint32_t latencyAvg, latencyMax;
+    if (cpu.getJoystick().takeLatencyStats(latencyAvg, latencyMax)) {
+        ESP_LOGI(TAG, "joystick latency: avg %d us, max %d us", (int)latencyAvg, (int)latencyMax);
     }
-    cia.latchRunDC08.store(dc08, std::memory_order_release);
-    uint8_t alarmdc08 = cia.latchAlarmDC08.load(std::memory_order_acquire);
-    if (dc08 == alarmdc08) {
-        uint8_t dc09      = cia.latchRunDC09.load(std::memory_order_acquire);
-        uint8_t alarmdc09 = cia.latchAlarmDC09.load(std::memory_order_acquire);
-        if (dc09 == alarmdc09) {
-            uint8_t dc0a      = cia.latchRunDC0A.load(std::memory_order_acquire);
-            uint8_t alarmdc0a = cia.latchAlarmDC0A.load(std::memory_order_acquire);
-            if (dc0a == alarmdc0a) {
-                uint8_t dc0b      = cia.latchRunDC0B.load(std::memory_order_acquire);
-                uint8_t alarmdc0b = cia.latchAlarmDC0B.load(std::memory_order_acquire);
-                if (dc0b == alarmdc0b) {
-                    return true;
-                }
-            }
-        }
+    if (konsoolkb.takeLatencyStats(latencyAvg, latencyMax)) {
+        ESP_LOGI(TAG, "keyboard latency: avg %d us, max %d us", (int)latencyAvg, (int)latencyMax);
     }
-    return false;
-}
-
-void IRAM_ATTR C64Emu::interruptTODFunc()
-{
-    if (cpu.cia1.isTODRunning.load(std::memory_order_acquire)) {
-        if (updateTOD(cpu.cia1)) {
-            cpu.cia1.isAlarm.store(true, std::memory_order_release);
-        }
-    }
-    if (cpu.cia2.isTODRunning.load(std::memory_order_acquire)) {
-        if (updateTOD(cpu.cia2)) {
-            cpu.cia2.isAlarm.store(true, std::memory_order_release);
-        }
+    // file cache
+    uint32_t cacheHits, cacheMisses, cacheBytes;
+    if (externalCmds.sdcard.takeCacheStats(cacheHits, cacheMisses, cacheBytes)) {
+        ESP_LOGI(TAG, "file cache: %d hits, %d misses, %d KB cached", (int)cacheHits, (int)cacheMisses,
+                 (int)(cacheBytes / 1024));
     }
+    vic.cntRefreshs            = 0;
+    numofburnedcyclespersecond = 0;
 }
 
 void C64Emu::handleKeyboardFunc()
 {
-    // check for keyboard inputs ca. each 8 ms
-    checkForKeyboardCnt++;
-    if (checkForKeyboardCnt == 8) {
-        konsoolkb.handleKeyPress();
-        checkForKeyboardCnt = 0;
-    }
+    // blocks until input events arrive
+    konsoolkb.handleKeyPress();
 }
 
 void C64Emu::cpuCode(void* parameter)
@@ -163,17 +104,6 @@ void C64Emu::cpuCode(void* parameter)
     // init LCD driver
     vic.initLCDController();
 
-    // interrupt each 100 ms to increment CIA real time clock (TOD)
-    TimerHandle_t tod_timer = xTimerCreate("TOD Timer",
-                                           pdMS_TO_TICKS(100),  // 100ms
-                                           pdTRUE,              // auto-reload
-                                           this,                // timer ID / context
-                                           [](TimerHandle_t xTimer) {
-                                               auto self = static_cast<C64Emu*>(pvTimerGetTimerID(xTimer));
-                                               self->interruptTODFuncWrapper();
-                                           });
-    xTimerStart(tod_timer, 0);
-
     cpu.run();
     // cpu runs forever -> no vTaskDelete(NULL);
 }
@@ -192,10 +122,16 @@ void C64Emu::powerOff()
 #endif
 }
 
+void C64Emu::setSampleRate(uint32_t rate)
+{
+    sid.requestSampleRate(rate);
+}
+
 void C64Emu::setup()
 {
     instance = this;
     ESP_LOGI(TAG, "Initializing C64 emulator");
+    TRACE_INIT();
 
     // allocate ram
     ram = new uint8_t[1 << 16];
@@ -213,7 +149,9 @@ void C64Emu::setup()
     cpu.init(ram, charset_rom, &vic, this);
 
     // init SID
-    sid.init(cpu.getSidRegs(), [](int16_t* buf, size_t num) { instance->i2s.write(buf, num); }, 8580);
+    sid.init(
+        cpu.getSidRegs(),
+        [](int16_t* buf, size_t num) { instance->i2s.write(buf, num, instance->sid.getSampleRate()); }, 8580);
 
     // init Menu system
     menuController.init(this);
@@ -231,12 +169,12 @@ void C64Emu::setup()
                             &cpuTask,        // Task handle
                             1);              // Core where the task should run
 
-    // Interrupt handler for keyboard IO (keyboard)
+    // Input task (keyboard), woken up by input events. Runs menu actions at a lower priority (KonsoolKB::MenuPriority).
     xTaskCreatePinnedToCore(handleKeyboardFuncWrapper,  // Keyboard task
                             "keyboardHandler",          //
                             4096,                       //
                             NULL,                       //
-                            0,                          //
+                            5,                          //
                             &interruptTask,             //
                             0);
 
@@ -37,20 +37,14 @@ extern "C" {
 class C64Emu {
    private:
     static C64Emu* instance;  // needed for wrapper methods
-    static void    interruptTODFuncWrapper()
-    {
-        if (instance != nullptr) {
-            instance->interruptTODFunc();
-        }
-    }
-
-    static void handleKeyboardFuncWrapper(void* parameter)
+    static void    handleKeyboardFuncWrapper(void* parameter)
     {
         while (true) {
             if (instance != nullptr) {
                 instance->handleKeyboardFunc();
+            } else {
+                vTaskDelay(10 / portTICK_PERIOD_MS);
             }
-            vTaskDelay(10 / portTICK_PERIOD_MS);
         }
     }
 
@@ -75,14 +69,12 @@ class C64Emu {
     SID         sid;
     I2S         i2s;
 
-    uint16_t checkForKeyboardCnt        = 0;
     uint8_t  throttlingCnt              = 0;
     uint32_t numofburnedcyclespersecond = 0;
 
     uint16_t cntSecondsForBatteryCheck;
 
     esp_timer_handle_t* interruptProfilingBatteryCheck = NULL;
-    esp_timer_handle_t* interruptTOD                   = NULL;
     esp_timer_handle_t* interruptSystem                = NULL;
     TaskHandle_t        cpuTask;
     TaskHandle_t        interruptTask;
@@ -90,11 +82,9 @@ class C64Emu {
     esp_timer_handle_t  profiling_timer;
 
     void handleKeyboardFunc();
-    void interruptTODFunc();
     void interruptSystemFunc();
     void interruptProfilingBatteryCheckFunc();
     void cpuCode(void* parameter);
-    bool updateTOD(CIA& cia);
 
     adc_oneshot_unit_handle_t adc1_handle;
     adc_cali_handle_t         adc_cali_handle;
@@ -109,6 +99,7 @@ class C64Emu {
     uint32_t       batteryVoltage = 0;
 
     void powerOff();
+    void setSampleRate(uint32_t rate);
     void setup();
     void loop();
 };
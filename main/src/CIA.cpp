@@ -15,12 +15,77 @@
  http://www.gnu.org/licenses/.
 */
 #include "CIA.hpp"
+#include "Config.hpp"
 
 // bit 4 of ciareg[0x0e] and ciareg[0x0f] is handled in CPUC64::setMem
 
-void CIA::checkAlarm() {
-    if (isAlarm.load(std::memory_order_acquire)) {
-        isAlarm.store(false, std::memory_order_release);
+// the TOD counts ticks of the mains frequency, CRA bit 7 selects the 50 Hz or 60 Hz divider
+#define TOD_MAINS_FREQ 50
+#define TOD_DAY        (24 * 60 * 60 * 10)
+
+static uint8_t fromBCD(uint8_t val) {
+    return (val >> 4) * 10 + (val & 0x0f);
+}
+
+static uint8_t toBCD(uint8_t val) {
+    return ((val / 10) << 4) | (val % 10);
+}
+
+// 12h clock with pm flag in BCD <-> tenths since midnight
+static uint32_t todFromRegs(uint8_t dc08, uint8_t dc09, uint8_t dc0a, uint8_t dc0b) {
+    uint32_t hours = fromBCD(dc0b & 0x1f) % 12;
+    if (dc0b & 0x80) {
+        hours += 12;
+    }
+    uint32_t tod = (((hours * 60 + fromBCD(dc0a & 0x7f)) * 60) + fromBCD(dc09 & 0x7f)) * 10 + (dc08 & 0x0f);
+    return tod % TOD_DAY;
+}
+
+static void todToRegs(uint32_t tod, uint8_t* regs) {
+    uint8_t hours = tod / (60 * 60 * 10);
+    uint8_t hour12 = hours % 12;
+    regs[0] = tod % 10;
+    regs[1] = toBCD((tod / 10) % 60);
+    regs[2] = toBCD((tod / (60 * 10)) % 60);
+    regs[3] = toBCD(hour12 == 0 ? 12 : hour12) | ((hours >= 12) ? 0x80 : 0);
+}
+
+// cycles per tenth of a second, scaled by the mains frequency to stay integer
+uint64_t CIA::cyclesPerTenth() const {
+    return (uint64_t)C64_PAL_CPUCLK * ((ciaReg[0x0e] & 0x80) ? 5 : 6);
+}
+
+uint32_t CIA::getTOD(uint64_t cycle) const {
+    if (!isTODRunning) {
+        return todBase;
+    }
+    uint64_t tenths = (cycle - todBaseCycle) * TOD_MAINS_FREQ / cyclesPerTenth();
+    return (todBase + tenths) % TOD_DAY;
+}
+
+void CIA::setTOD(uint32_t tod, uint64_t cycle) {
+    todBase = tod;
+    todBaseCycle = cycle;
+}
+
+void CIA::predictAlarm(uint64_t cycle) {
+    if (!isTODRunning) {
+        alarmCycle = UINT64_MAX;
+        return;
+    }
+    uint64_t elapsed = (cycle - todBaseCycle) * TOD_MAINS_FREQ / cyclesPerTenth();
+    uint32_t delta = (todAlarm + TOD_DAY - (todBase + elapsed) % TOD_DAY) % TOD_DAY;
+    if (delta == 0) {
+        // alarm matches the current time, next match is one day later
+        delta = TOD_DAY;
+    }
+    uint64_t divisor = cyclesPerTenth();
+    alarmCycle = todBaseCycle + ((elapsed + delta) * divisor + TOD_MAINS_FREQ - 1) / TOD_MAINS_FREQ;
+}
+
+void CIA::checkAlarm(uint64_t cycle) {
+    if (cycle >= alarmCycle) {
+        predictAlarm(alarmCycle);
         latchDC0D |= 0x04;
         if (ciaReg[0x0d] & 4) {
             latchDC0D |= 0x80;
@@ -28,36 +93,53 @@ void CIA::checkAlarm() {
     }
 }
 
-void CIA::checkTimerA(uint8_t deltaT) {
+// Timers counting system cycles are not decremented step by step. While such a timer runs, only the cycle of its
+// next underflow is stored, its current value is derived from it on read.
+
+uint16_t CIA::getTimerA(uint64_t cycle) const {
+    if (timerAUnderflow == UINT64_MAX) {
+        return timerA;
+    }
+    return timerAUnderflow - cycle - 1;
+}
+
+uint16_t CIA::getTimerB(uint64_t cycle) const {
+    if (timerBUnderflow == UINT64_MAX) {
+        return timerB;
+    }
+    return timerBUnderflow - cycle - 1;
+}
+
+void CIA::scheduleTimerA(uint64_t cycle) {
+    // timer running and not clocked by CNT pin?
+    if ((ciaReg[0x0e] & 0x21) == 0x01) {
+        timerAUnderflow = cycle + timerA + 1;
+    } else {
+        timerAUnderflow = UINT64_MAX;
+    }
+}
+
+void CIA::scheduleTimerB(uint64_t cycle) {
+    // timer running and counting system cycles?
+    if ((ciaReg[0x0f] & 0x61) == 0x01) {
+        timerBUnderflow = cycle + timerB + 1;
+    } else {
+        timerBUnderflow = UINT64_MAX;
+    }
+}
+
+void CIA::underflowA(uint64_t count) {
     uint8_t reg0e = ciaReg[0x0e];
-    if (!(reg0e & 1)) {
-        // timer stopped
-        return;
+    if ((reg0e & 0x02) && !(reg0e & 0x04) && (count & 1)) {
+        ciaReg[0x01] ^= 0x40;
     }
-    if (reg0e & 0x20) {
-        // timer clocked by CNT pin
-        return;
+    // ignore "toggle bit for one cycle"
+    latchDC0D |= 0x01;
+    if (ciaReg[0x0d] & 1) {
+        latchDC0D |= 0x80;
     }
-    int32_t tmp = timerA - deltaT;
-    timerA      = (tmp < 0) ? 0 : tmp;
-    if (timerA == 0) {
-        underflowTimerA = true;
-        if (reg0e & 0x02) {
-            if (!(reg0e & 0x04)) {
-                ciaReg[0x01] ^= 0x40;
-            }
-            // ignore "toggle bit for one cycle"
-        }
-        latchDC0D |= 0x01;
-        if (!(reg0e & 8)) {
-            timerA = (latchDC05 << 8) + latchDC04;
-        } else {
-            ciaReg[0x0e] &= 0xfe;
-        }
-        if (ciaReg[0x0d] & 1) {
-            latchDC0D |= 0x80;
-        }
-        if ((ciaReg[0x0e] & 0x40) && (serBitNR != 0)) {
+    if (reg0e & 0x40) {
+        for (uint64_t i = 0; (i < count) && (serBitNR != 0); i++) {
             serBitNR--;
             if (serBitNR == 0) {
                 latchDC0D |= 0x08;
@@ -71,42 +153,64 @@ void CIA::checkTimerA(uint8_t deltaT) {
             }
         }
     }
+    // timer B counting timer A underflows?
+    if ((ciaReg[0x0f] & 0x61) == 0x41) {
+        if (count <= timerB) {
+            timerB -= count;
+            return;
+        }
+        uint32_t latch = (latchDC07 << 8) + latchDC06;
+        uint64_t rest  = count - timerB - 1;
+        if (ciaReg[0x0f] & 8) {
+            ciaReg[0x0f] &= 0xfe;
+            timerB = latch;
+            underflowB(1);
+        } else {
+            timerB = latch - rest % (latch + 1);
+            underflowB(1 + rest / (latch + 1));
+        }
+    }
 }
 
-void CIA::checkTimerB(uint8_t deltaT) {
+void CIA::underflowB(uint64_t count) {
     uint8_t reg0f = ciaReg[0x0f];
-    if (!(reg0f & 1)) {
-        // timer stopped
-        return;
+    if ((reg0f & 0x02) && !(reg0f & 0x04) && (count & 1)) {
+        ciaReg[0x01] ^= 0x80;
     }
-    uint8_t bit56 = ciaReg[0x0f] & 0x60;
-    if (bit56 == 0) {
-        int32_t tmp = timerB - deltaT;
-        timerB      = (tmp < 0) ? 0 : tmp;
-    } else if (bit56 == 0x40) {
-        if (underflowTimerA) {
-            underflowTimerA = false;
-            timerB--;
-        }
-    } else {
-        return;
+    // ignore "toggle bit for one cycle"
+    latchDC0D |= 0x02;
+    if (ciaReg[0x0d] & 2) {
+        latchDC0D |= 0x80;
     }
-    if (timerB == 0) {
-        if (reg0f & 0x02) {
-            if (!(reg0f & 0x04)) {
-                ciaReg[0x01] ^= 0x80;
-            }
-            // ignore "toggle bit for one cycle"
-        }
-        latchDC0D |= 0x02;
-        if (!(reg0f & 8)) {
-            timerB = (latchDC07 << 8) + latchDC06;
+}
+
+void CIA::updateTimers(uint64_t cycle) {
+    if (cycle >= timerAUnderflow) {
+        uint32_t latch = (latchDC05 << 8) + latchDC04;
+        uint64_t count = 1;
+        if (ciaReg[0x0e] & 8) {
+            // one-shot
+            ciaReg[0x0e] &= 0xfe;
+            timerA          = latch;
+            timerAUnderflow = UINT64_MAX;
         } else {
-            ciaReg[0x0f] &= 0xfe;
+            count           += (cycle - timerAUnderflow) / (latch + 1);
+            timerAUnderflow += count * (latch + 1);
         }
-        if (ciaReg[0x0d] & 2) {
-            latchDC0D |= 0x80;
+        underflowA(count);
+    }
+    if (cycle >= timerBUnderflow) {
+        uint32_t latch = (latchDC07 << 8) + latchDC06;
+        uint64_t count = 1;
+        if (ciaReg[0x0f] & 8) {
+            ciaReg[0x0f] &= 0xfe;
+            timerB          = latch;
+            timerBUnderflow = UINT64_MAX;
+        } else {
+            count           += (cycle - timerBUnderflow) / (latch + 1);
+            timerBUnderflow += count * (latch + 1);
         }
+        underflowB(count);
     }
 }
 
@@ -115,7 +219,6 @@ void CIA::init(bool isCIA1) {
         ciaReg[i] = 0;
     }
 
-    underflowTimerA = false;
     serBitNR        = 0;
     serBitNRNext    = 0;
     latchDC04       = 0;
@@ -125,18 +228,21 @@ void CIA::init(bool isCIA1) {
     latchDC0D       = 0;
     timerA          = 0;
     timerB          = 0;
+    timerAUnderflow = UINT64_MAX;
+    timerBUnderflow = UINT64_MAX;
 
-    isTODRunning.store(false, std::memory_order_release);
+    // after reset the TOD is stopped at 1:00:00.0 AM
+    isTODRunning = false;
     isTODFreezed = false;
-    isAlarm.store(false, std::memory_order_release);
-    latchRunDC08.store(0, std::memory_order_release);
-    latchRunDC09.store(0, std::memory_order_release);
-    latchRunDC0A.store(0, std::memory_order_release);
-    latchRunDC0B.store(0, std::memory_order_release);
-    latchAlarmDC08.store(0, std::memory_order_release);
-    latchAlarmDC09.store(0, std::memory_order_release);
-    latchAlarmDC0A.store(0, std::memory_order_release);
-    latchAlarmDC0B.store(0, std::memory_order_release);
+    todBase = 60 * 60 * 10;
+    todBaseCycle = 0;
+    todAlarm = 0;
+    alarmDC08 = 0;
+    alarmDC09 = 0;
+    alarmDC0A = 0;
+    alarmDC0B = 0;
+    alarmCycle = UINT64_MAX;
+    todToRegs(todBase, &ciaReg[0x08]);
 
     if (isCIA1) {
         ciaReg[0] = 127;
@@ -153,42 +259,26 @@ CIA::CIA(bool isCIA1) {
     init(isCIA1);
 }
 
-uint8_t CIA::getCommonCIAReg(uint8_t ciaIdx) {
+uint8_t CIA::getCommonCIAReg(uint8_t ciaIdx, uint64_t cycle) {
+    checkTimers(cycle);
     if (ciaIdx == 0x04) {
-        return timerA & 0xff;
+        return getTimerA(cycle) & 0xff;
     } else if (ciaIdx == 0x05) {
-        return (timerA >> 8) & 0xff;
+        return (getTimerA(cycle) >> 8) & 0xff;
     } else if (ciaIdx == 0x06) {
-        return timerB & 0xff;
+        return getTimerB(cycle) & 0xff;
     } else if (ciaIdx == 0x07) {
-        return (timerB >> 8) & 0xff;
-    } else if (ciaIdx == 0x08) {
-        uint8_t val;
-        if (isTODFreezed) {
-            val = ciaReg[ciaIdx];
-        } else {
-            val = latchRunDC08.load(std::memory_order_acquire);
+        return (getTimerB(cycle) >> 8) & 0xff;
+    } else if ((ciaIdx >= 0x08) && (ciaIdx <= 0x0b)) {
+        // reading hours freezes the registers until tenths are read
+        if (!isTODFreezed) {
+            todToRegs(getTOD(cycle), &ciaReg[0x08]);
         }
-        isTODFreezed = false;
-        return val;
-    } else if (ciaIdx == 0x09) {
-        if (isTODFreezed) {
-            return ciaReg[ciaIdx];
-        } else {
-            return latchRunDC09.load(std::memory_order_acquire);
-        }
-    } else if (ciaIdx == 0x0a) {
-        if (isTODFreezed) {
-            return ciaReg[ciaIdx];
-        } else {
-            return latchRunDC0A.load(std::memory_order_acquire);
+        if (ciaIdx == 0x0b) {
+            isTODFreezed = true;
+        } else if (ciaIdx == 0x08) {
+            isTODFreezed = false;
         }
-    } else if (ciaIdx == 0x0b) {
-        isTODFreezed = true;
-        ciaReg[0x08] = latchRunDC08.load(std::memory_order_acquire);
-        ciaReg[0x09] = latchRunDC09.load(std::memory_order_acquire);
-        ciaReg[0x0a] = latchRunDC0A.load(std::memory_order_acquire);
-        ciaReg[0x0b] = latchRunDC0B.load(std::memory_order_acquire);
         return ciaReg[ciaIdx];
     } else if (ciaIdx == 0x0d) {
         uint8_t val = latchDC0D;
@@ -199,7 +289,8 @@ uint8_t CIA::getCommonCIAReg(uint8_t ciaIdx) {
     }
 }
 
-void CIA::setCommonCIAReg(uint8_t ciaIdx, uint8_t val) {
+void CIA::setCommonCIAReg(uint8_t ciaIdx, uint8_t val, uint64_t cycle) {
+    checkTimers(cycle);
     if (ciaIdx == 0x04) {
         latchDC04 = val;
     } else if (ciaIdx == 0x05) {
@@ -216,36 +307,24 @@ void CIA::setCommonCIAReg(uint8_t ciaIdx, uint8_t val) {
         if (!(ciaReg[0x0f] & 1)) {
             timerB = (latchDC07 << 8) + latchDC06;
         }
-    } else if (ciaIdx == 0x08) {
+    } else if ((ciaIdx >= 0x08) && (ciaIdx <= 0x0b)) {
         if (ciaReg[0x0f] & 128) {
-            latchAlarmDC08.store(val, std::memory_order_release);
+            uint8_t* alarm[] = {&alarmDC08, &alarmDC09, &alarmDC0A, &alarmDC0B};
+            *alarm[ciaIdx - 0x08] = val;
+            todAlarm = todFromRegs(alarmDC08, alarmDC09, alarmDC0A, alarmDC0B);
         } else {
-            ciaReg[0x08] = val;
-            latchRunDC08.store(val, std::memory_order_release);
-            latchRunDC09.store(ciaReg[0x09], std::memory_order_release);
-            latchRunDC0A.store(ciaReg[0x0a], std::memory_order_release);
-            latchRunDC0B.store(ciaReg[0x0b], std::memory_order_release);
-        }
-        isTODRunning.store(true, std::memory_order_release);
-    } else if (ciaIdx == 0x09) {
-        if (ciaReg[0x0f] & 128) {
-            latchAlarmDC09.store(val, std::memory_order_release);
-        } else {
-            ciaReg[0x09] = val;
-        }
-    } else if (ciaIdx == 0x0a) {
-        if (ciaReg[0x0f] & 128) {
-            latchAlarmDC0A.store(val, std::memory_order_release);
-        } else {
-            ciaReg[0x0a] = val;
-        }
-    } else if (ciaIdx == 0x0b) {
-        isTODRunning.store(false, std::memory_order_release);
-        if (ciaReg[0x0f] & 128) {
-            latchAlarmDC0B.store(val, std::memory_order_release);
-        } else {
-            ciaReg[0x0b] = val;
+            // writing hours stops the clock, writing tenths starts it again
+            uint8_t regs[4];
+            todToRegs(getTOD(cycle), regs);
+            regs[ciaIdx - 0x08] = val;
+            setTOD(todFromRegs(regs[0], regs[1], regs[2], regs[3]), cycle);
+            if (ciaIdx == 0x08) {
+                isTODRunning = true;
+            } else if (ciaIdx == 0x0b) {
+                isTODRunning = false;
+            }
         }
+        predictAlarm(cycle);
     } else if (ciaIdx == 0x0c) {
         if (serBitNR == 0) {
             serBitNR = 8;
@@ -260,15 +339,27 @@ void CIA::setCommonCIAReg(uint8_t ciaIdx, uint8_t val) {
             ciaReg[ciaIdx] &= ~(val | 0x80);
         }
     } else if (ciaIdx == 0x0e) {
+        bool divChanged = (ciaReg[ciaIdx] ^ val) & 0x80;
+        if (divChanged) {
+            // TOD divider changes, continue counting from the current time
+            setTOD(getTOD(cycle), cycle);
+        }
+        timerA         = getTimerA(cycle);
         ciaReg[ciaIdx] = val;
         if (val & 0x10) {
             timerA = (latchDC05 << 8) + latchDC04;
         }
+        scheduleTimerA(cycle);
+        if (divChanged) {
+            predictAlarm(cycle);
+        }
     } else if (ciaIdx == 0x0f) {
+        timerB         = getTimerB(cycle);
         ciaReg[ciaIdx] = val;
         if (val & 0x10) {
             timerB = (latchDC07 << 8) + latchDC06;
         }
+        scheduleTimerB(cycle);
     } else {
         ciaReg[ciaIdx] = val;
     }
@@ -17,7 +17,6 @@
 #ifndef CIA_H
 #define CIA_H
 
-#include <atomic>
 #include <cstdint>
 
 // register dc0d:
@@ -29,7 +28,6 @@ class CIA {
 public:
   uint8_t ciaReg[0x10];
 
-  bool underflowTimerA;
   uint8_t serBitNR;
   uint8_t serBitNRNext;
   uint8_t latchDC04;
@@ -37,27 +35,46 @@ public:
   uint8_t latchDC06;
   uint8_t latchDC07;
   uint8_t latchDC0D; // read latch register
-  uint16_t timerA;
+  uint16_t timerA; // timer values while not counting system cycles
   uint16_t timerB;
+  uint64_t timerAUnderflow; // cycle of the next underflow, UINT64_MAX if none
+  uint64_t timerBUnderflow;
 
-  std::atomic<bool> isTODRunning;
-  bool isTODFreezed;
-  std::atomic<bool> isAlarm;
-  std::atomic<uint8_t> latchRunDC08; // TOD running
-  std::atomic<uint8_t> latchRunDC09;
-  std::atomic<uint8_t> latchRunDC0A;
-  std::atomic<uint8_t> latchRunDC0B;
-  std::atomic<uint8_t> latchAlarmDC08; // set alarm
-  std::atomic<uint8_t> latchAlarmDC09;
-  std::atomic<uint8_t> latchAlarmDC0A;
-  std::atomic<uint8_t> latchAlarmDC0B;
+  // TOD clock, derived from the emulated cycle counter and computed on read
+  // (time of day in tenths of a second since midnight, 24h)
+  bool isTODRunning;
+  bool isTODFreezed; // ciaReg[0x08] - ciaReg[0x0b] hold the read latch
+  uint32_t todBase;  // time of day at todBaseCycle
+  uint64_t todBaseCycle;
+  uint32_t todAlarm; // alarm time of day
+  uint8_t alarmDC08; // alarm registers as written
+  uint8_t alarmDC09;
+  uint8_t alarmDC0A;
+  uint8_t alarmDC0B;
+  uint64_t alarmCycle; // cycle of the next alarm, UINT64_MAX if none
 
   CIA(bool isCIA1);
   void init(bool isCIA1);
-  void checkAlarm();
-  void checkTimerA(uint8_t deltaT);
-  void checkTimerB(uint8_t deltaT);
-  uint8_t getCommonCIAReg(uint8_t ciaidx);
-  void setCommonCIAReg(uint8_t ciaidx, uint8_t val);
+  void checkAlarm(uint64_t cycle);
+  void updateTimers(uint64_t cycle);
+  inline void checkTimers(uint64_t cycle) {
+    if ((cycle >= timerAUnderflow) || (cycle >= timerBUnderflow)) {
+      updateTimers(cycle);
+    }
+  }
+  uint8_t getCommonCIAReg(uint8_t ciaidx, uint64_t cycle);
+  void setCommonCIAReg(uint8_t ciaidx, uint8_t val, uint64_t cycle);
+
+private:
+  uint64_t cyclesPerTenth() const;
+  uint32_t getTOD(uint64_t cycle) const;
+  void setTOD(uint32_t tod, uint64_t cycle);
+  void predictAlarm(uint64_t cycle);
+  uint16_t getTimerA(uint64_t cycle) const;
+  uint16_t getTimerB(uint64_t cycle) const;
+  void scheduleTimerA(uint64_t cycle);
+  void scheduleTimerB(uint64_t cycle);
+  void underflowA(uint64_t count);
+  void underflowB(uint64_t count);
 };
 #endif // CIA_H
@@ -19,7 +19,10 @@
 #include <esp_random.h>
 #include <cstdint>
 #include "C64Emu.hpp"
+#include "EventTrace.hpp"
 #include "JoystickInitializationException.h"
+#include "Profiler.hpp"
+#include "RasterTracer.hpp"
 #include "esp_attr.h"
 #include "esp_timer.h"
 #include "freertos/idf_additions.h"
@@ -28,9 +31,19 @@
 #include "roms/kernal.h"
 
 static const uint8_t NUMCIACHECKS = 2;
+// sample the joystick pins every n rasterlines (8 lines = ca. 0.5 ms)
+static const uint8_t JOYSTICKSAMPLELINES = 8;
 
 static const char* TAG = "CPUC64";
 
+// KERNAL LOAD and SAVE routines (default targets of the vectors at $0330 / $0332) are patched with a halt opcode,
+// cmd6502halt serves device 8 from the SD card and continues with the replaced instruction for other devices. The
+// patched bytes are also copied when a program copies the KERNAL to the RAM below it, the copy is served the same way.
+static const uint16_t KERNAL_LOAD = 0xf4a5;  // sta $93
+static const uint16_t KERNAL_SAVE = 0xf5ed;  // lda $ba
+static const uint8_t  TRAP_OPCODE = 0x02;
+static const uint8_t  TRAP_DEVICE = 8;
+
 // read dc00 / dc01:
 // from
 // https://retrocomputing.stackexchange.com/questions/6421/reading-both-keyboard-and-joystick-with-non-kernal-code-on-c64
@@ -43,6 +56,11 @@ static const char* TAG = "CPUC64";
 // & ddra) | (input & ~ddra);"
 
 uint8_t CPUC64::getMem(uint16_t addr) {
+#if defined(USE_DEBUGGER)
+    if (watchGuest && debugger.checkAccess(addr, Debugger::READ)) {
+        debugStop("read watchpoint", addr);
+    }
+#endif
     if ((!bankARAM) && ((addr >= 0xa000) && (addr <= 0xbfff))) {
         //    basic rom
         return basic_rom[addr - 0xa000];
@@ -82,7 +100,6 @@ uint8_t CPUC64::getMem(uint16_t addr) {
         }
         // ** CIA 1 **
         else if (addr <= 0xdcff) {
-            kbjoystickmode = menuDataStore->getInt("kb_joystick_port", 0);
             uint8_t ciaidx = (addr - 0xdc00) % 0x10;
             if (ciaidx == 0x00) {
                 uint8_t ddra  = cia1.ciaReg[0x02];
@@ -135,7 +152,7 @@ uint8_t CPUC64::getMem(uint16_t addr) {
                 }
                 return (cia1.ciaReg[0x01] | ~ddrb) & input;
             }
-            return cia1.getCommonCIAReg(ciaidx);
+            return cia1.getCommonCIAReg(ciaidx, getCycles());
         }
         // ** CIA 2 **
         else if (addr <= 0xddff) {
@@ -149,7 +166,7 @@ uint8_t CPUC64::getMem(uint16_t addr) {
             } else if (ciaidx == 0x0d) {
                 nmiAck = true;
             }
-            return cia2.getCommonCIAReg(ciaidx);
+            return cia2.getCommonCIAReg(ciaidx, getCycles());
         }
     } else if ((!bankDRAM) && (addr >= 0xd000) && (addr <= 0xdfff)) {
         // dxxx character rom
@@ -239,6 +256,11 @@ void CPUC64::adaptVICBaseAddrs(bool fromcia) {
 }
 
 void CPUC64::setMem(uint16_t addr, uint8_t val) {
+#if defined(USE_DEBUGGER)
+    if (watchGuest && debugger.checkAccess(addr, Debugger::WRITE)) {
+        debugStop("write watchpoint", addr);
+    }
+#endif
     if (bankDIO && (addr >= 0xd000) && (addr <= 0xdfff)) {
         // ** VIC **
         if (addr <= 0xd3ff) {
@@ -294,7 +316,7 @@ void CPUC64::setMem(uint16_t addr, uint8_t val) {
                 uint8_t ddrb        = cia1.ciaReg[0x03];
                 cia1.ciaReg[ciaidx] = (cia1.ciaReg[ciaidx] & ~ddrb) | (val & ddrb);
             } else {
-                cia1.setCommonCIAReg(ciaidx, val);
+                cia1.setCommonCIAReg(ciaidx, val, getCycles());
             }
         }
         // ** CIA 2 **
@@ -320,7 +342,7 @@ void CPUC64::setMem(uint16_t addr, uint8_t val) {
                 // adapt VIC base addresses
                 adaptVICBaseAddrs(true);
             } else {
-                cia2.setCommonCIAReg(ciaidx, val);
+                cia2.setCommonCIAReg(ciaidx, val, getCycles());
             }
         }
     }
@@ -339,7 +361,90 @@ uint8_t *CPUC64::getSidRegs() {
     return sidreg;
 }
 
+void CPUC64::getTrapFilename(char* name) {
+    uint8_t  len  = ram[0xb7];
+    uint16_t addr = ram[0xbb] + (ram[0xbc] << 8);
+    if (len > 16) len = 16;
+    for (uint8_t i = 0; i < len; i++) {
+        name[i] = D64Image::petsciiToAscii(getMem(addr + i));
+    }
+    name[len] = '\0';
+}
+
+// return from the KERNAL routine to the caller of LOAD / SAVE (rts)
+void CPUC64::returnFromTrap() {
+    uint8_t pcl = ram[0x100 + ++sp];
+    uint8_t pch = ram[0x100 + ++sp];
+    pc          = (pcl + 1 + (pch << 8));
+    numofcycles += 6;
+}
+
+void CPUC64::trapLoad() {
+    if ((ram[0xba] != TRAP_DEVICE) || (a != 0)) {
+        // other device or verify: execute sta $93 and continue in the KERNAL
+        ram[0x93] = a;
+        pc++;
+        numofcycles += 3;
+        return;
+    }
+    char     name[17];
+    uint16_t endaddr = 0;
+    getTrapFilename(name);
+    uint8_t err = c64emu->externalCmds.kernalLoad(name, ram[0xb9], ram[0xc3] + (ram[0xc4] << 8), endaddr);
+    if (err == 0) {
+        ram[0x90] = 0x40;  // EOF
+        ram[0xae] = endaddr & 0xff;
+        ram[0xaf] = endaddr >> 8;
+        x         = endaddr & 0xff;
+        y         = endaddr >> 8;
+        cflag     = false;
+    } else {
+        ram[0x90] = (err == 4) ? 0x42 : 0x80;  // EOF + time out resp. device not present
+        a         = err;
+        cflag     = true;
+    }
+    returnFromTrap();
+}
+
+void CPUC64::trapSave() {
+    if (ram[0xba] != TRAP_DEVICE) {
+        // other device: execute lda $ba and continue in the KERNAL
+        a     = ram[0xba];
+        zflag = (a == 0);
+        nflag = (a & 0x80);
+        pc++;
+        numofcycles += 3;
+        return;
+    }
+    char name[17];
+    getTrapFilename(name);
+    uint8_t err = c64emu->externalCmds.kernalSave(name, ram[0xc1] + (ram[0xc2] << 8), ram[0xae] + (ram[0xaf] << 8));
+    if (err == 0) {
+        ram[0x90] = 0;
+        cflag     = false;
+    } else {
+        ram[0x90] = 0x80;
+        a         = err;
+        cflag     = true;
+    }
+    returnFromTrap();
+}
+
 void CPUC64::cmd6502halt() {
+    uint16_t addr = pc - 1;
+    // in RAM only the trap opcode itself, other halt opcodes jam there as anywhere else
+    if (!bankERAM || (ram[addr] == TRAP_OPCODE)) {
+        if (addr == KERNAL_LOAD) {
+            trapLoad();
+            return;
+        } else if (addr == KERNAL_SAVE) {
+            trapSave();
+            return;
+        }
+    }
+    if (debug) {
+        instrTrace.freeze("cpu halt");
+    }
     cpuhalted = true;
     ESP_LOGE(TAG, "illegal code, cpu halted, pc = %x", pc - 1);
 }
@@ -375,65 +480,129 @@ uint16_t CPUC64::getPC() {
     return pc;
 }
 
-void CPUC64::checkciatimers(uint8_t cycles) {
-    // CIA 1 TOD alarm
-    cia1.checkAlarm();
-    // check for CIA 1 TOD alarm interrupt
-    if (((cia1.latchDC0D & 0x84) == 0x84) && (!iflag)) {
-        setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
-    }
-    // CIA 1 Timer A
-    cia1.checkTimerA(cycles);
-    // check for CIA 1 Timer A interrupt
-    if (((cia1.latchDC0D & 0x81) == 0x81) && (!iflag)) {
-        setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
-    }
-    // CIA 1 Timer B
-    cia1.checkTimerB(cycles);
-    // check for CIA 1 Timer B interrupt
-    if (((cia1.latchDC0D & 0x82) == 0x82) && (!iflag)) {
-        setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
-    }
-    // check for CIA 1 SDR interrupt
-    if (((cia1.latchDC0D & 0x88) == 0x88) && (!iflag)) {
+void CPUC64::checkciatimers() {
+    PROFILE_SCOPE(CIA);
+    uint64_t cycle = getCycles();
+    // CIA 1 TOD alarm, timer A, timer B and SDR
+    cia1.checkAlarm(cycle);
+    cia1.checkTimers(cycle);
+    // check for CIA 1 interrupt
+    if ((cia1.latchDC0D & 0x80) && (!iflag)) {
         setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
     }
     if (!deactivateCIA2) {
-        // CIA 2 TOD alarm
-        cia2.checkAlarm();
-        // check for CIA 2 TOD alarm interrupt
-        if (((cia2.latchDC0D & 0x84) == 0x84) && nmiAck) {
+        // CIA 2 TOD alarm, timer A, timer B and SDR
+        cia2.checkAlarm(cycle);
+        cia2.checkTimers(cycle);
+        // check for CIA 2 interrupt
+        if ((cia2.latchDC0D & 0x80) && nmiAck) {
             nmiAck = false;
             setPCToIntVec(getMem(0xfffa) + (getMem(0xfffb) << 8), false);
         }
-        // CIA 2 Timer A
-        cia2.checkTimerA(cycles);
-        // check for CIA 2 Timer A interrupt
-        if (((cia2.latchDC0D & 0x81) == 0x81) && nmiAck) {
-            nmiAck = false;
-            setPCToIntVec(getMem(0xfffa) + (getMem(0xfffb) << 8), false);
+    }
+}
+
+// Execute instructions up to the given cycle of the raster line. The traced variant records every instruction and
+// stops the trace when the debug start address is reached, the sampled one feeds the PC sampler and the debugged one
+// stops at breakpoints. The plain variant contains no debug code at all.
+template <bool Traced, bool Sampled, bool Debugged>
+void CPUC64::executeUntil(uint8_t cycles) {
+    while (numofcycles < cycles) {
+        if (cpuhalted) {
+            break;
         }
-        // CIA 2 Timer B
-        cia2.checkTimerB(cycles);
-        // check for CIA 2 Timer B interrupt
-        if (((cia2.latchDC0D & 0x82) == 0x82) && nmiAck) {
-            nmiAck = false;
-            setPCToIntVec(getMem(0xfffa) + (getMem(0xfffb) << 8), false);
+#if defined(USE_DEBUGGER)
+        if (Debugged) {
+            instrpc = pc;
+            if (debugger.checkBreak(pc)) {
+                debugStop("breakpoint", pc);
+                break;
+            }
         }
-        // check for CIA 2 SDR interrupt
-        if (((cia2.latchDC0D & 0x88) == 0x88) && nmiAck) {
-            nmiAck = false;
-            setPCToIntVec(getMem(0xfffa) + (getMem(0xfffb) << 8), false);
+#endif
+        if (Sampled) {
+            pcSampler.check(getCycles(), pc, !bankARAM, !bankERAM);
+        }
+        uint8_t opcode = getMem(pc);
+        if (Traced && !instrTrace.isFrozen()) {
+            uint8_t status = 0x20 | cflag | (zflag << 1) | (iflag << 2) | (dflag << 3) | (bflag << 4) | (vflag << 6) |
+                             (nflag << 7);
+            instrTrace.record(getCycles(), pc, opcode, a, x, y, sp, status);
+            if ((pc == debugstartaddr) && (debugstartaddr != 0)) {
+                instrTrace.freeze("pc hit");
+            }
         }
+        pc++;
+        execute(opcode);
+    }
+}
+
+template <bool Debugged>
+void CPUC64::executeVariant(uint8_t cycles) {
+    if (debug) {
+        if (sampling) {
+            executeUntil<true, true, Debugged>(cycles);
+        } else {
+            executeUntil<true, false, Debugged>(cycles);
+        }
+    } else if (sampling) {
+        executeUntil<false, true, Debugged>(cycles);
+    } else {
+        executeUntil<false, false, Debugged>(cycles);
+    }
+}
+
+void CPUC64::executeChunk(uint8_t cycles) {
+#if defined(USE_DEBUGGER)
+    if (debugger.isActive()) {
+        watchGuest = debugger.isWatching();
+        executeVariant<true>(cycles);
+        watchGuest = false;
+        return;
     }
+#endif
+    executeVariant<false>(cycles);
 }
 
-void CPUC64::logDebugInfo() {
-    if (debug && (debuggingstarted || (debugstartaddr == 0) || (pc == debugstartaddr))) {
-        debuggingstarted = true;
-        // debug (use LOGE because LOGI doesn't work here...)
-        ESP_LOGE(TAG, "pc: %2x, cmd: %s, a: %x, x: %x, y: %x, sp: %x, sr: %x", pc, cmdName[getMem(pc)], a, x, y, sp,
-                 sr);
+#if defined(USE_DEBUGGER)
+// Halt the cpu at the end of the current instruction, the first hit of an instruction is reported
+void CPUC64::debugStop(const char *reason, uint16_t addr) {
+    if (cpuhalted) {
+        return;
+    }
+    if (debug) {
+        instrTrace.freeze(reason);
+    }
+    cpuhalted    = true;
+    debugStopped = true;
+    ESP_LOGI(TAG, "%s at %04x, pc = %x, a = %x, x = %x, y = %x, sp = %x", reason, addr, instrpc, a, x, y, sp);
+}
+
+// Only continue a stop of the debugger, a jammed cpu needs a reset
+void CPUC64::continueDebug() {
+    if (cpuhalted && debugStopped) {
+        debugStopped = false;
+        debugger.resume();
+        cpuhalted = false;
+    } else if (cpuhalted) {
+        ESP_LOGI(TAG, "cpu jammed, not continued");
+    }
+}
+#endif
+
+void CPUC64::setDebug(bool on) {
+    if (on) {
+        debug = instrTrace.start();
+    } else if (debug) {
+        debug = false;
+        instrTrace.dump(cmdName, Config::INSTRTRACEDUMPLEN);
+    }
+}
+
+// Dump a trace that was stopped by a trigger, tracing ends with it
+void CPUC64::checkTrace() {
+    if (debug && instrTrace.isFrozen()) {
+        setDebug(false);
     }
 }
 
@@ -442,18 +611,29 @@ void IRAM_ATTR CPUC64::run() {
     cpuhalted             = false;
     debug                 = false;
     debugstartaddr        = 0;
-    debuggingstarted      = false;
+    sampling              = false;
+#if defined(USE_DEBUGGER)
+    instrpc               = 0;
+#endif
     numofcycles           = 0;
     static uint8_t badlinecycles = 0;
     static uint8_t spritecycles = 0;
     static int8_t cycles_extra  = 0;
     while (true) {
         if (cpuhalted) {
+            // cpu jammed, only external commands (e.g. reset) can continue
+            checkTrace();
+            c64emu->externalCmds.drainCommands();
+            vTaskDelay(1);
+            RASTERTRACE_RESUME();
             continue;
         }
 
         // prepare next rasterline
         badlinecycles = vic->nextRasterline();
+        if ((joystickmode != 0) && ((vic->rasterline % JOYSTICKSAMPLELINES) == 0)) {
+            joystick.sample();
+        }
         spritecycles = vic->spriteDmaCycles();
 
         if (badlinecycles) {
@@ -469,6 +649,8 @@ void IRAM_ATTR CPUC64::run() {
         }
         // execute CPU cycles and check CIA timers
         // (4 = average number of cycles for an instruction)
+        // cycles of interrupts taken since the end of the last line pass as emulated time
+        linestartcycle          += numofcycles;
         numofcycles              = 0;
         uint8_t numofcyclestoexe = 63 - badlinecycles - spritecycles - cycles_extra;
         uint8_t n                = 1;
@@ -480,45 +662,56 @@ void IRAM_ATTR CPUC64::run() {
         // Do CIA checks half way through the rasterline
         // But not during bad lines
         for (uint8_t i = 0; i < n - 1; i++) {
-            while (numofcycles < sumtmp) {
-                if (cpuhalted) {
-                    break;
-                }
-                logDebugInfo();
-                execute(getMem(pc++));
+            {
+                PROFILE_SCOPE(CPU);
+                executeChunk(sumtmp);
             }
-            checkciatimers(tmp);
+            checkciatimers();
             sumtmp += tmp;
         }
         // Finish the raster line
-        tmp = numofcyclestoexe - numofcycles;
-        while (numofcycles < numofcyclestoexe) {
-            if (cpuhalted) {
-                break;
-            }
-            logDebugInfo();
-            execute(getMem(pc++));
+        {
+            PROFILE_SCOPE(CPU);
+            executeChunk(numofcyclestoexe);
         }
 
         // Make sure 63 cycles per rasterline on average
         cycles_extra = numofcycles - numofcyclestoexe;
         // TODO Add cycles access, > 63 gets subtracted from next rasterline
-        checkciatimers(tmp);
+        checkciatimers();
+        linestartcycle += numofcycles + badlinecycles + spritecycles;
+        numofcyclespersecond.fetch_add(numofcycles + badlinecycles + spritecycles, std::memory_order_relaxed);
+        // keep getCycles() exact until the next line starts
+        numofcycles = 0;
         // draw rasterline
         vic->drawRasterline();
         // sprite collision interrupt?
         if ((vic->vicreg[0x19] & 0x86) && (vic->vicreg[0x1a] & 6) && (!iflag)) {
             setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
         }
-        if (restorenmi && nmiAck) {
+        // an injected run/stop key must be visible when the NMI handler checks it
+        if (restorenmi && nmiAck && !c64emu->konsoolkb.injectionPending()) {
             nmiAck     = false;
             restorenmi = false;
             setPCToIntVec(getMem(0xfffa) + (getMem(0xfffb) << 8), false);
         }
+        RASTERTRACE_LINE(vic->rasterline);
 
-        // throttle CPU at end of frame, and wait for the frame to be displayed
+        // execute external commands and throttle CPU at end of frame, and wait for the frame to be displayed
         if (vic->rasterline == 311) {
+            PROFILE_END_FRAME(CPU, I2S);
+            RASTERTRACE_FRAME();
+            TRACE_END(CPU, "frame");
+            checkTrace();
+            sampling = pcSampler.poll(getCycles());
+            TRACE_BEGIN(CPU, "commands");
+            c64emu->externalCmds.drainCommands();
+            TRACE_END(CPU, "commands");
+            TRACE_BEGIN(CPU, "waitFrame");
             xSemaphoreTake(frameRateMutex, 1000);
+            TRACE_END(CPU, "waitFrame");
+            TRACE_BEGIN(CPU, "frame");
+            RASTERTRACE_RESUME();
         }
     }
 }
@@ -534,6 +727,9 @@ void CPUC64::initMemAndRegs() {
     bflag         = false;
     nmiAck        = true;
     restorenmi    = false;
+#if defined(USE_DEBUGGER)
+    debugStopped = false;
+#endif
     uint16_t addr = 0xfffc - 0xe000;
     pc            = kernal_rom[addr] + (kernal_rom[addr + 1] << 8);
 }
@@ -546,11 +742,12 @@ void CPUC64::init(uint8_t* ram, uint8_t* charrom, VIC* vic, C64Emu* c64emu) {
     this->c64emu  = c64emu;
     measuredcycles.store(0, std::memory_order_release);
     adjustcycles.store(0, std::memory_order_release);
+    numofcyclespersecond.store(0, std::memory_order_relaxed);
     joystickmode         = 0;
     kbjoystickmode       = 0;
     deactivateCIA2       = false;
     numofcycles          = 0;
-    numofcyclespersecond = 0;
+    linestartcycle       = 0;
     try {
         joystick.init();
     } catch (const JoystickInitializationException& e) {
@@ -560,12 +757,19 @@ void CPUC64::init(uint8_t* ram, uint8_t* charrom, VIC* vic, C64Emu* c64emu) {
     // Setup refresh rate semaphore
     frameRateMutex = xSemaphoreCreateBinary();
 
+    // KERNAL traps for LOAD and SAVE of device 8, only if the ROM has the expected code there
+    if ((kernal_rom[KERNAL_LOAD - 0xe000] == 0x85) && (kernal_rom[KERNAL_SAVE - 0xe000] == 0xa5)) {
+        kernal_rom[KERNAL_LOAD - 0xe000] = TRAP_OPCODE;
+        kernal_rom[KERNAL_SAVE - 0xe000] = TRAP_OPCODE;
+    } else {
+        ESP_LOGI(TAG, "unknown KERNAL, no LOAD / SAVE traps");
+    }
+
     // Setup Memory for first boot
     initMemAndRegs();
 }
 
 void CPUC64::setPC(uint16_t newPC) {
-    std::lock_guard<std::mutex> lock(pcMutex);
     pc = newPC;
 }
 
@@ -592,9 +796,14 @@ void CPUC64::exeSubroutine(uint16_t addr, uint8_t rega, uint8_t regx, uint8_t re
     ram[0x033d]     = addr & 0xff;
     ram[0x033e]     = addr >> 8;
     pc              = 0x033c;
+
+    // the subroutine's cycles pass as emulated time, but do not count for the current raster line
+    uint8_t tcycles = numofcycles;
     while (true) {
         uint8_t nextopc = getMem(pc++);
         execute(nextopc);
+        linestartcycle += (uint8_t)(numofcycles - tcycles);
+        numofcycles     = tcycles;
         if ((sp == tsp) && (nextopc == 0x60)) {  // rts
             break;
         }
@@ -614,6 +823,6 @@ void CPUC64::exeSubroutine(uint16_t addr, uint8_t rega, uint8_t regx, uint8_t re
     pc    = tpc;
 }
 
-void CPUC64::setKeycodes(uint8_t keycode1, uint8_t keycode2) {
-    c64emu->konsoolkb.setKbcodes(keycode1, keycode2);
+void CPUC64::setKeycodes(uint8_t keycode1, uint8_t keycode2, uint32_t holdMs) {
+    c64emu->konsoolkb.setKbcodes(keycode1, keycode2, holdMs);
 }
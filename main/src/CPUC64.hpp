@@ -20,10 +20,12 @@
 #include <stdint.h>
 #include "CIA.hpp"
 #include "CPU6502.hpp"
+#include "Debugger.hpp"
+#include "InstrTrace.hpp"
+#include "PcSampler.hpp"
 #include "Joystick.hpp"
 #include "VIC.hpp"
 #include <cstdint>
-#include <mutex>
 #include "freertos/idf_additions.h"
 #include "menuoverlay/MenuDataStore.hpp"
 
@@ -37,7 +39,7 @@ private:
   uint8_t *kernalrom;
   uint8_t *charrom;
   Joystick joystick;
-  MenuDataStore* menuDataStore = MenuDataStore::getInstance();
+  MenuSetting<int> kbJoystickPort;
 
   uint8_t sidreg[0x100];
 
@@ -50,21 +52,47 @@ private:
   bool bankDIO;
   uint8_t register1;
 
-  std::mutex pcMutex;
-
   bool nmiAck;
 
+  // emulated cycles up to the start of the current rasterline
+  uint64_t linestartcycle;
+
+  // instructions executed while debug is on
+  InstrTrace instrTrace;
+  // guest PC sampling is running
+  bool sampling;
+#if defined(USE_DEBUGGER)
+  // address of the instruction being executed while the debugger is active
+  uint16_t instrpc;
+  // watchpoints are only checked while guest instructions run, not on accesses of the emulator itself
+  bool watchGuest = false;
+  // the cpu was halted by a breakpoint or watchpoint, not by an illegal opcode
+  bool debugStopped = false;
+  void debugStop(const char *reason, uint16_t addr);
+#endif
+
+  void getTrapFilename(char *name);
+  void returnFromTrap();
+  void trapLoad();
+  void trapSave();
+
   inline void adaptVICBaseAddrs(bool fromcia) __attribute__((always_inline));
   inline void decodeRegister1(uint8_t val) __attribute__((always_inline));
-  inline void checkciatimers(uint8_t cycles) __attribute__((always_inline));
-  inline void logDebugInfo() __attribute__((always_inline));
+  inline void checkciatimers() __attribute__((always_inline));
+  template <bool Traced, bool Sampled, bool Debugged>
+  inline void executeUntil(uint8_t cycles) __attribute__((always_inline));
+  template <bool Debugged> inline void executeVariant(uint8_t cycles) __attribute__((always_inline));
+  inline void executeChunk(uint8_t cycles) __attribute__((always_inline));
+  void checkTrace();
 
 public:
   VIC *vic;
   CIA cia1;
   CIA cia2;
 
-  CPUC64() : cia1(true), cia2(false) {}
+  CPUC64()
+      : kbJoystickPort("kb_joystick_port", 0, [this](int port) { kbjoystickmode = port; }), cia1(true),
+        cia2(false) {}
 
   // public only for logging / debugging
   uint8_t getA();
@@ -74,7 +102,8 @@ public:
   uint8_t getSR();
   uint16_t getPC();
 
-  uint32_t numofcyclespersecond;
+  // cycles emulated since the last profiling report, added by the CPU task and taken by the profiling timer
+  std::atomic<uint32_t> numofcyclespersecond;
   std::atomic<uint16_t> adjustcycles;
   std::atomic<uint16_t> measuredcycles;
 
@@ -83,18 +112,32 @@ public:
   uint8_t kbjoystickmode;
   bool deactivateCIA2;
   bool debug;
+  // the instruction trace stops when this address is reached (0 = never)
   uint16_t debugstartaddr;
-  bool debuggingstarted;
   uint64_t presleeptime;
 
   bool restorenmi;
 
+  // emulated cycle counter, only advances while the CPU runs
+  uint64_t getCycles() { return linestartcycle + numofcycles; }
+
   uint8_t getMem(uint16_t addr) override;
   void setMem(uint16_t addr, uint8_t val) override;
   SemaphoreHandle_t getFrameRateMutex() { return frameRateMutex; }
+  Joystick &getJoystick() { return joystick; }
 
   uint8_t *getSidRegs();
 
+  // switch the instruction trace on, switching it off dumps it
+  void setDebug(bool on);
+  // profiler of the guest program
+  PcSampler pcSampler;
+#if defined(USE_DEBUGGER)
+  // breakpoints and watchpoints, a hit halts the cpu until continueDebug(), which leaves other halts alone
+  Debugger debugger;
+  void continueDebug();
+#endif
+
   void cmd6502halt() override;
   void run() override;
 
@@ -102,7 +145,7 @@ public:
   void init(uint8_t *ram, uint8_t *charrom, VIC *vic, C64Emu *c64emu);
   void setPC(uint16_t pc);
   void exeSubroutine(uint16_t addr, uint8_t rega, uint8_t regx, uint8_t regy);
-  void setKeycodes(uint8_t keycode1, uint8_t keycode2);
+  void setKeycodes(uint8_t keycode1, uint8_t keycode2, uint32_t holdMs);
 };
 
 #endif // CPUC64_H
@@ -27,6 +27,15 @@
 
 #define BOARD_KONSOOL
 
+// Cycle profiler of the emulator subsystems with an optional HUD, compiled out when not defined
+// #define USE_PROFILER
+// Tracer of the host time per raster line, keeps the worst frames for a CSV dump to the console
+// #define USE_RASTERTRACER
+// Begin/end events of the emulator tasks, exported as Chrome trace JSON
+// #define USE_EVENTTRACE
+// PC breakpoints and memory watchpoints of the 6502, set by external commands
+// #define USE_DEBUGGER
+
 
 struct Config {
 
@@ -63,4 +72,16 @@ struct Config {
 
     // number of "steps" to average throttling
     static const uint8_t THROTTELINGNUMSTEPS = 50;
+
+    // PSRAM used to cache recently loaded PRG files and disk images, largest file that is cached
+    static const size_t FILECACHESIZE        = 4 * 1024 * 1024;
+    static const size_t FILECACHEMAXFILESIZE = 256 * 1024;
+
+    // number of instructions logged when the instruction trace is dumped
+    static const uint16_t INSTRTRACEDUMPLEN = 1000;
+
+    // emulated cycles between two samples of the guest PC sampler (odd, so it does not lock to the raster line), number
+    // of entries of its report
+    static const uint32_t PCSAMPLERINTERVAL = 97;
+    static const uint8_t  PCSAMPLERTOPN     = 20;
 };  // namespace Config
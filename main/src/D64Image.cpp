@@ -0,0 +1,288 @@
+#include "D64Image.hpp"
+#include <cctype>
+#include <cstring>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char* TAG = "D64Image";
+
+// image sizes without and with the error info bytes for 35 and 40 track images
+static const size_t D64_SIZE_35     = 174848;
+static const size_t D64_SIZE_35_ERR = 175531;
+static const size_t D64_SIZE_40     = 196608;
+static const size_t D64_SIZE_40_ERR = 197376;
+
+static const uint8_t DIR_TRACK = 18;
+
+static uint8_t sectorsPerTrack(uint8_t track)
+{
+    return (track <= 17) ? 21 : (track <= 24) ? 19 : (track <= 30) ? 18 : 17;
+}
+
+char D64Image::petsciiToAscii(uint8_t c)
+{
+    if ((c >= 0x41) && (c <= 0x5a)) {
+        return c + 0x20;
+    } else if ((c >= 0xc1) && (c <= 0xda)) {
+        return c - 0x80;
+    } else if ((c >= 0x20) && (c <= 0x3f)) {
+        return c;
+    }
+    return '_';
+}
+
+D64Image::~D64Image()
+{
+    heap_caps_free(image);
+}
+
+const uint8_t* D64Image::getSector(uint8_t track, uint8_t sector) const
+{
+    if ((track == 0) || (track > numTracks) || (sector >= sectorsPerTrack(track))) {
+        return nullptr;
+    }
+    size_t offset = 0;
+    for (uint8_t t = 1; t < track; t++) {
+        offset += sectorsPerTrack(t);
+    }
+    return image + (offset + sector) * 256;
+}
+
+bool D64Image::mount(const char* name, const uint8_t* data, size_t size)
+{
+    int64_t starttime = esp_timer_get_time();
+    uint8_t tracks    = 0;
+    unmount();
+    if ((size == D64_SIZE_35) || (size == D64_SIZE_35_ERR)) {
+        tracks = 35;
+    } else if ((size == D64_SIZE_40) || (size == D64_SIZE_40_ERR)) {
+        tracks = 40;
+    } else {
+        ESP_LOGE(TAG, "%s is not a D64 image", name);
+        return false;
+    }
+    if (image == nullptr) {
+        // allocated once for the largest image and kept for later mounts
+        image = (uint8_t*)heap_caps_malloc(D64_SIZE_40, MALLOC_CAP_SPIRAM);
+        if (image == nullptr) {
+            ESP_LOGE(TAG, "no memory for disk image");
+            return false;
+        }
+    }
+    // the error info bytes are not needed
+    imageSize = (tracks == 35) ? D64_SIZE_35 : D64_SIZE_40;
+    memcpy(image, data, imageSize);
+    numTracks = tracks;
+    parseBAM();
+    parseDirectory();
+    ESP_LOGI(TAG, "mounted %s: %d tracks, %d files, %d blocks free in %d ms", name, numTracks, (int)entries.size(),
+             blocksFree, (int)((esp_timer_get_time() - starttime) / 1000));
+    return true;
+}
+
+void D64Image::unmount()
+{
+    numTracks  = 0;
+    imageSize  = 0;
+    blocksFree = 0;
+    entries.clear();
+}
+
+void D64Image::parseBAM()
+{
+    const uint8_t* bam = getSector(DIR_TRACK, 0);
+    memcpy(diskName, bam + 0x90, sizeof(diskName));
+    memcpy(diskId, bam + 0xa2, sizeof(diskId));
+    // free sectors per track for tracks 1 - 35, the directory track does not count
+    blocksFree = 0;
+    for (uint8_t t = 1; t <= 35; t++) {
+        if (t != DIR_TRACK) {
+            blocksFree += bam[4 + (t - 1) * 4];
+        }
+    }
+}
+
+void D64Image::parseDirectory()
+{
+    uint8_t track  = DIR_TRACK;
+    uint8_t sector = 1;
+    // the directory can not have more sectors than the directory track, this also stops circular chains
+    for (uint8_t n = 0; (track != 0) && (n < sectorsPerTrack(DIR_TRACK)); n++) {
+        const uint8_t* sec = getSector(track, sector);
+        if (sec == nullptr) {
+            ESP_LOGE(TAG, "bad directory sector %d/%d", track, sector);
+            break;
+        }
+        for (uint8_t i = 0; i < 8; i++) {
+            const uint8_t* dirent = sec + i * 32;
+            if (dirent[2] == 0) {
+                continue;  // scratched or unused
+            }
+            DirEntry entry;
+            entry.type   = dirent[2];
+            entry.track  = dirent[3];
+            entry.sector = dirent[4];
+            entry.blocks = dirent[30] | (dirent[31] << 8);
+            memcpy(entry.rawName, dirent + 5, sizeof(entry.rawName));
+            uint8_t len = 0;
+            while ((len < 16) && (entry.rawName[len] != 0xa0)) {
+                entry.name[len] = petsciiToAscii(entry.rawName[len]);
+                len++;
+            }
+            entry.name[len] = '\0';
+            entries.push_back(entry);
+        }
+        track  = sec[0];
+        sector = sec[1];
+    }
+}
+
+int D64Image::find(const char* pattern) const
+{
+    for (size_t i = 0; i < entries.size(); i++) {
+        if ((entries[i].type & 0x07) != FILETYPE_PRG) {
+            continue;
+        }
+        const char* p = pattern;
+        const char* n = entries[i].name;
+        // like on the 1541, everything after a '*' matches
+        while ((*p != '\0') && (*p != '*')) {
+            if ((*n == '\0') || ((*p != '?') && (tolower(*p) != tolower(*n)))) {
+                break;
+            }
+            p++;
+            n++;
+        }
+        if ((*p == '*') || ((*p == '\0') && (*n == '\0'))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool D64Image::load(int index, uint8_t* ram, uint16_t& endaddr, int32_t addr) const
+{
+    if (!isMounted() || (index < 0) || (index >= (int)entries.size())) {
+        return false;
+    }
+    int64_t  starttime = esp_timer_get_time();
+    uint8_t  track     = entries[index].track;
+    uint8_t  sector    = entries[index].sector;
+    uint32_t hdrAddr   = 0;
+    uint32_t pos       = 0;
+    uint8_t  hdrBytes  = 0;
+    // a file can not have more sectors than the image, this also stops circular chains
+    for (size_t n = 0; track != 0; n++) {
+        const uint8_t* sec = getSector(track, sector);
+        if ((sec == nullptr) || (n >= imageSize / 256)) {
+            ESP_LOGE(TAG, "broken sector chain in %s at %d/%d", entries[index].name, track, sector);
+            return false;
+        }
+        // the last sector holds the index of its last used byte instead of the next sector
+        const uint8_t* data = sec + 2;
+        size_t         len  = (sec[0] != 0) ? 254 : ((sec[1] >= 2) ? sec[1] - 1 : 0);
+        while ((len > 0) && (hdrBytes < 2)) {
+            hdrAddr |= *data++ << (hdrBytes++ * 8);
+            len--;
+            if (hdrBytes == 2) {
+                pos  = (addr >= 0) ? addr : hdrAddr;
+                addr = pos;
+            }
+        }
+        if (len > 0x10000 - pos) {
+            len = 0x10000 - pos;
+        }
+        memcpy(ram + pos, data, len);
+        pos += len;
+        track  = sec[0];
+        sector = sec[1];
+    }
+    if (hdrBytes < 2) {
+        return false;
+    }
+    ESP_LOGI(TAG, "loaded %s: %d bytes to $%04x in %d us", entries[index].name, (int)(pos - addr), (int)addr,
+             (int)(esp_timer_get_time() - starttime));
+    endaddr = pos;
+    return true;
+}
+
+bool D64Image::loadDirectory(uint8_t* ram, uint16_t& endaddr, uint16_t addr) const
+{
+    static const char* typeNames[] = {"DEL", "SEQ", "PRG", "USR", "REL"};
+
+    uint32_t pos  = addr;
+    bool     fits = true;
+    uint8_t  text[40];
+    uint8_t  len;
+    // one BASIC line: link to the next line, line number, text, end of line. Lines that would not leave room for
+    // the end of the program below $10000 are dropped.
+    auto addLine = [&](uint16_t lineNo) {
+        uint32_t next = pos + 4 + len + 1;
+        if (!fits || (next + 2 > 0x10000)) {
+            fits = false;
+            return;
+        }
+        ram[pos]      = next & 0xff;
+        ram[pos + 1]  = next >> 8;
+        ram[pos + 2]  = lineNo & 0xff;
+        ram[pos + 3]  = lineNo >> 8;
+        memcpy(ram + pos + 4, text, len);
+        ram[pos + 4 + len] = 0;
+        pos                = next;
+    };
+
+    // header: reverse on, disk name and id
+    len         = 0;
+    text[len++] = 0x12;
+    text[len++] = '"';
+    for (uint8_t i = 0; i < sizeof(diskName); i++) {
+        text[len++] = (diskName[i] == 0xa0) ? ' ' : diskName[i];
+    }
+    text[len++] = '"';
+    text[len++] = ' ';
+    for (uint8_t i = 0; i < sizeof(diskId); i++) {
+        text[len++] = (diskId[i] == 0xa0) ? ' ' : diskId[i];
+    }
+    addLine(0);
+
+    for (const DirEntry& entry : entries) {
+        // names start in the same column for up to 3 digit block counts
+        len         = 0;
+        text[len++] = ' ';
+        if (entry.blocks < 100) text[len++] = ' ';
+        if (entry.blocks < 10) text[len++] = ' ';
+        text[len++]     = '"';
+        uint8_t nameLen = 0;
+        while ((nameLen < 16) && (entry.rawName[nameLen] != 0xa0)) {
+            text[len++] = entry.rawName[nameLen++];
+        }
+        text[len++] = '"';
+        for (; nameLen < 16; nameLen++) {
+            text[len++] = ' ';
+        }
+        // unclosed files are marked with '*', locked files with '<'
+        text[len++]      = (entry.type & 0x80) ? ' ' : '*';
+        const char* type = ((entry.type & 0x07) <= FILETYPE_REL) ? typeNames[entry.type & 0x07] : "???";
+        memcpy(text + len, type, 3);
+        len += 3;
+        if (entry.type & 0x40) {
+            text[len++] = '<';
+        }
+        addLine(entry.blocks);
+    }
+
+    len = strlen("BLOCKS FREE.");
+    memcpy(text, "BLOCKS FREE.", len);
+    addLine(blocksFree);
+
+    if (!fits) {
+        ESP_LOGW(TAG, "directory does not fit to $%04x", addr);
+        return false;
+    }
+    // end of program
+    ram[pos++] = 0;
+    ram[pos++] = 0;
+    endaddr    = pos;
+    return true;
+}
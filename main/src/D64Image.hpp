@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 1541 disk image (.d64) held completely in PSRAM. The BAM and the directory are parsed once when the image is
+// mounted, files are loaded by following their track/sector chains in memory, so no SD access is needed after mount.
+class D64Image {
+   public:
+    static const uint8_t FILETYPE_DEL = 0;
+    static const uint8_t FILETYPE_SEQ = 1;
+    static const uint8_t FILETYPE_PRG = 2;
+    static const uint8_t FILETYPE_USR = 3;
+    static const uint8_t FILETYPE_REL = 4;
+
+    struct DirEntry {
+        uint8_t  rawName[16];  // PETSCII, padded with $a0
+        char     name[17];     // ASCII, lower case for unshifted letters like the names typed on the C64 screen
+        uint8_t  type;         // file type byte of the directory entry
+        uint8_t  track;        // first sector of the file
+        uint8_t  sector;
+        uint16_t blocks;
+    };
+
+   private:
+    uint8_t*              image     = nullptr;
+    size_t                imageSize = 0;
+    uint8_t               numTracks = 0;
+    uint8_t               diskName[16];
+    uint8_t               diskId[5];
+    uint16_t              blocksFree = 0;
+    std::vector<DirEntry> entries;
+
+    const uint8_t* getSector(uint8_t track, uint8_t sector) const;
+    void           parseBAM();
+    void           parseDirectory();
+
+   public:
+    D64Image() = default;
+    ~D64Image();
+    D64Image(const D64Image&)            = delete;
+    D64Image& operator=(const D64Image&) = delete;
+
+    // PETSCII to ASCII like the file names typed on the C64 screen: unshifted letters become lower case
+    static char petsciiToAscii(uint8_t c);
+
+    // Mount a copy of the image data, name is only used for logging
+    bool mount(const char* name, const uint8_t* data, size_t size);
+    void unmount();
+    bool isMounted() const
+    {
+        return numTracks != 0;
+    }
+
+    const std::vector<DirEntry>& getEntries() const
+    {
+        return entries;
+    }
+
+    // Index of the first PRG file matching a C64 file name pattern with '*' and '?', -1 if there is none
+    int find(const char* pattern) const;
+
+    // Load a file to its load address or to addr if given, returns false on error. endaddr is the address after the
+    // last byte loaded (0 for a file that ends at $ffff).
+    bool load(int index, uint8_t* ram, uint16_t& endaddr, int32_t addr = -1) const;
+
+    // Write the directory as a BASIC program to addr like LOAD"$",8 does, returns false if it does not fit below
+    // $10000
+    bool loadDirectory(uint8_t* ram, uint16_t& endaddr, uint16_t addr) const;
+};
@@ -0,0 +1,70 @@
+#include "Debugger.hpp"
+
+#if defined(USE_DEBUGGER)
+#include <cstring>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char* TAG = "Debugger";
+
+Debugger::~Debugger()
+{
+    heap_caps_free(flags);
+}
+
+bool Debugger::set(uint16_t from, uint16_t to, uint8_t flag)
+{
+    if (flags == nullptr) {
+        // allocated on first use and kept
+        flags = (uint8_t*)heap_caps_malloc(0x10000, MALLOC_CAP_SPIRAM);
+        if (flags == nullptr) {
+            ESP_LOGE(TAG, "no memory for breakpoints");
+            return false;
+        }
+        memset(flags, 0, 0x10000);
+    }
+    for (uint32_t addr = from; addr <= to; addr++) {
+        flags[addr] |= flag;
+    }
+    update(from, to);
+    return true;
+}
+
+void Debugger::clear(uint16_t from, uint16_t to, uint8_t flag)
+{
+    if (flags == nullptr) {
+        return;
+    }
+    for (uint32_t addr = from; addr <= to; addr++) {
+        flags[addr] &= ~flag;
+    }
+    update(from, to);
+}
+
+void Debugger::clearAll()
+{
+    clear(0x0000, 0xffff, BREAK | READ | WRITE);
+}
+
+// Recompute the page flags of the pages from to to, then the state of the whole debugger
+void Debugger::update(uint16_t from, uint16_t to)
+{
+    for (uint32_t page = from >> 8; page <= (uint32_t)(to >> 8); page++) {
+        uint8_t        pageflags = 0;
+        const uint8_t* p         = &flags[page << 8];
+        for (uint16_t i = 0; i < 0x100; i++) {
+            pageflags |= p[i];
+        }
+        pageFlags[page] = pageflags;
+    }
+    uint8_t all = 0;
+    for (uint16_t page = 0; page < 0x100; page++) {
+        all |= pageFlags[page];
+    }
+    breaking = (all & BREAK) != 0;
+    watching = (all & (READ | WRITE)) != 0;
+    if (!breaking) {
+        resuming = false;
+    }
+}
+#endif
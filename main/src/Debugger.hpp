@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Config.hpp"
+
+#if defined(USE_DEBUGGER)
+#include <cstdint>
+
+// PC breakpoints and read / write watchpoints of the 6502. Every address has a flag byte in PSRAM, a table with the
+// flags of all addresses of a page lets the checks end after one lookup in pages without breakpoints resp.
+// watchpoints. The CPU only runs its checking loop while the debugger is active and only checks memory accesses while
+// watchpoints are set. Must only be used by the CPU task.
+class Debugger {
+   public:
+    enum Flag : uint8_t { BREAK = 1, READ = 2, WRITE = 4 };
+
+   private:
+    uint8_t* flags          = nullptr;
+    uint8_t  pageFlags[256] = {};
+    bool     breaking       = false;
+    bool     watching       = false;
+    bool     resuming       = false;
+
+    void update(uint16_t from, uint16_t to);
+
+   public:
+    Debugger() = default;
+    ~Debugger();
+    Debugger(const Debugger&)            = delete;
+    Debugger& operator=(const Debugger&) = delete;
+
+    // Set resp. clear the flags for the addresses from to to (inclusive), set returns false if there is no memory
+    bool set(uint16_t from, uint16_t to, uint8_t flag);
+    void clear(uint16_t from, uint16_t to, uint8_t flag);
+    void clearAll();
+
+    bool isActive() const
+    {
+        return breaking || watching;
+    }
+    bool isWatching() const
+    {
+        return watching;
+    }
+
+    // Do not stop at a breakpoint on the next instruction, to continue from it
+    void resume()
+    {
+        resuming = true;
+    }
+
+    // True if the CPU has to stop before executing the instruction at pc
+    inline bool checkBreak(uint16_t pc) __attribute__((always_inline))
+    {
+        if (resuming) {
+            resuming = false;
+            return false;
+        }
+        return (pageFlags[pc >> 8] & BREAK) && (flags[pc] & BREAK);
+    }
+
+    // True if an access of kind READ or WRITE to addr is watched
+    inline bool checkAccess(uint16_t addr, Flag kind) __attribute__((always_inline))
+    {
+        return (pageFlags[addr >> 8] & kind) && (flags[addr] & kind);
+    }
+};
+#endif
@@ -0,0 +1,132 @@
+#include "DirIndex.hpp"
+#include <dirent.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char* TAG = "DirIndex";
+
+DirIndex::~DirIndex()
+{
+    heap_caps_free(entries);
+    heap_caps_free(names);
+}
+
+bool DirIndex::refresh(const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        count = 0;
+        valid = false;
+        return false;
+    }
+    if (valid && (st.st_mtime == dirMtime)) {
+        return false;
+    }
+    dirMtime = st.st_mtime;
+    build(path);
+    return true;
+}
+
+bool DirIndex::addEntry(const char* name, size_t nameLen, uint32_t size, uint16_t loadAddr, uint8_t type)
+{
+    if (count == entryCapacity) {
+        size_t newCapacity = entryCapacity ? entryCapacity * 2 : 64;
+        Entry* newEntries  = (Entry*)heap_caps_realloc(entries, newCapacity * sizeof(Entry), MALLOC_CAP_SPIRAM);
+        if (newEntries == nullptr) return false;
+        entries       = newEntries;
+        entryCapacity = newCapacity;
+    }
+    if (namesSize + nameLen + 1 > namesCapacity) {
+        size_t newCapacity = namesCapacity ? namesCapacity * 2 : 2048;
+        while (namesSize + nameLen + 1 > newCapacity) newCapacity *= 2;
+        char* newNames = (char*)heap_caps_realloc(names, newCapacity, MALLOC_CAP_SPIRAM);
+        if (newNames == nullptr) return false;
+        names         = newNames;
+        namesCapacity = newCapacity;
+    }
+    memcpy(names + namesSize, name, nameLen);
+    names[namesSize + nameLen] = '\0';
+    entries[count].nameOffset  = namesSize;
+    entries[count].size        = size;
+    entries[count].loadAddr    = loadAddr;
+    entries[count].type        = type;
+    namesSize += nameLen + 1;
+    count++;
+    return true;
+}
+
+void DirIndex::build(const char* path)
+{
+    int64_t starttime = esp_timer_get_time();
+    count             = 0;
+    namesSize         = 0;
+    valid             = false;
+
+    DIR* dir = opendir(path);
+    if (dir == nullptr) {
+        ESP_LOGE(TAG, "cannot open %s", path);
+        return;
+    }
+    char           full_path[300];
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        size_t len = strlen(ent->d_name);
+        if (len <= 4) continue;
+        uint8_t type;
+        if (strcmp(ent->d_name + len - 4, ".prg") == 0) {
+            type = TYPE_PRG;
+        } else if (strcmp(ent->d_name + len - 4, ".d64") == 0) {
+            type = TYPE_D64;
+        } else {
+            continue;
+        }
+
+        // size and load address come from the file itself, a file that cannot be read is listed without them
+        uint32_t    size     = 0;
+        uint16_t    loadAddr = 0;
+        struct stat st;
+        uint8_t     hdr[2];
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, ent->d_name);
+        int fd = open(full_path, O_RDONLY);
+        if (fd >= 0) {
+            if (fstat(fd, &st) == 0) size = st.st_size;
+            if ((type == TYPE_PRG) && (read(fd, hdr, 2) == 2)) loadAddr = hdr[0] | (hdr[1] << 8);
+            close(fd);
+        }
+        if (!addEntry(ent->d_name, len - 4, size, loadAddr, type)) {
+            ESP_LOGE(TAG, "out of memory, index of %s truncated to %d entries", path, (int)count);
+            break;
+        }
+    }
+    closedir(dir);
+
+    const char* pool = names;
+    std::sort(entries, entries + count, [pool](const Entry& a, const Entry& b) {
+        return strcasecmp(pool + a.nameOffset, pool + b.nameOffset) < 0;
+    });
+    valid = true;
+    ESP_LOGI(TAG, "indexed %d files of %s in %d ms", (int)count, path,
+             (int)((esp_timer_get_time() - starttime) / 1000));
+}
+
+size_t DirIndex::findPrefix(const char* prefix) const
+{
+    size_t      len  = strlen(prefix);
+    const char* pool = names;
+    // names are sorted case insensitive, so all names with the prefix follow the first one not below it
+    const Entry* it  = std::lower_bound(entries, entries + count, prefix, [pool, len](const Entry& e, const char* p) {
+        return strncasecmp(pool + e.nameOffset, p, len) < 0;
+    });
+    if ((it == entries + count) || (strncasecmp(names + it->nameOffset, prefix, len) != 0)) {
+        return count;
+    }
+    return it - entries;
+}
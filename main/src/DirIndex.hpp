@@ -0,0 +1,69 @@
+#pragma once
+
+#include <time.h>
+#include <cstddef>
+#include <cstdint>
+
+// Sorted index of the PRG files and D64 images of a directory, kept in PSRAM. Built once and only rebuilt when the
+// directory's mtime changes or the index was invalidated (e.g. after a save), so paging and prefix search need no
+// directory scans.
+class DirIndex {
+   public:
+    static const uint8_t TYPE_PRG = 0;
+    static const uint8_t TYPE_D64 = 1;
+
+    struct Entry {
+        uint32_t nameOffset;  // name without extension in the name pool, zero terminated
+        uint32_t size;        // file size in bytes
+        uint16_t loadAddr;    // load address from the PRG header
+        uint8_t  type;
+    };
+
+   private:
+    Entry* entries       = nullptr;
+    char*  names         = nullptr;
+    size_t count         = 0;
+    size_t entryCapacity = 0;
+    size_t namesSize     = 0;
+    size_t namesCapacity = 0;
+    time_t dirMtime      = 0;
+    bool   valid         = false;
+
+    bool addEntry(const char* name, size_t nameLen, uint32_t size, uint16_t loadAddr, uint8_t type);
+    void build(const char* path);
+
+   public:
+    DirIndex() = default;
+    ~DirIndex();
+    DirIndex(const DirIndex&)            = delete;
+    DirIndex& operator=(const DirIndex&) = delete;
+
+    // Rebuild the index if needed, returns true if it was rebuilt
+    bool refresh(const char* path);
+    void invalidate()
+    {
+        valid = false;
+    }
+    // Drop all entries, e.g. while there is no card
+    void clear()
+    {
+        count = 0;
+        valid = false;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+    const Entry& getEntry(size_t i) const
+    {
+        return entries[i];
+    }
+    const char* getName(size_t i) const
+    {
+        return names + entries[i].nameOffset;
+    }
+
+    // Index of the first entry whose name starts with prefix (case insensitive), size() if there is none
+    size_t findPrefix(const char* prefix) const;
+};
@@ -0,0 +1,88 @@
+#include "EventTrace.hpp"
+
+#if defined(USE_EVENTTRACE)
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char* TAG = "EventTrace";
+
+static const char* trackNames[EventTrace::NUMTRACKS] = {"CPU", "input", "display", "timer", "sdcard"};
+
+EventTrace::Ring  EventTrace::rings[EventTrace::NUMTRACKS];
+std::atomic<bool> EventTrace::enabled{false};
+
+void EventTrace::init()
+{
+    for (uint8_t t = 0; t < NUMTRACKS; t++) {
+        rings[t].events = (Event*)heap_caps_malloc(RINGSIZE * sizeof(Event), MALLOC_CAP_SPIRAM);
+        if (rings[t].events == nullptr) {
+            ESP_LOGE(TAG, "no memory for event trace");
+            return;
+        }
+    }
+    enabled = true;
+}
+
+bool EventTrace::exportJson(FILE* out)
+{
+    if (rings[NUMTRACKS - 1].events == nullptr) {
+        return false;
+    }
+    // let running writers finish their event. A writer that is still past the enabled check records at most one
+    // more event, the heads are never reset, so that event just counts for the next export.
+    enabled = false;
+    vTaskDelay(1);
+
+    // oldest event of all tracks, timestamps are written relative to it
+    uint32_t first[NUMTRACKS];
+    uint32_t head[NUMTRACKS];
+    bool     haveBase = false;
+    uint32_t base     = 0;
+    for (uint8_t t = 0; t < NUMTRACKS; t++) {
+        head[t]  = rings[t].head.load(std::memory_order_acquire);
+        first[t] = rings[t].exported;
+        // the slot of the oldest event may be overwritten by such a late writer
+        if (head[t] - first[t] > RINGSIZE - 1) {
+            first[t] = head[t] - (RINGSIZE - 1);
+        }
+        if (first[t] != head[t]) {
+            uint32_t ts = rings[t].events[first[t] & (RINGSIZE - 1)].ts;
+            if (!haveBase || ((int32_t)(ts - base) < 0)) {
+                base = ts;
+            }
+            haveBase = true;
+        }
+    }
+
+    bool ok = fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out) >= 0;
+    for (uint8_t t = 0; t < NUMTRACKS; t++) {
+        ok = ok && (fprintf(out,
+                            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                            "\"args\":{\"name\":\"%s\"}}",
+                            t, trackNames[t]) > 0);
+        // the ring may start in the middle of a span, skip its end
+        uint32_t depth = 0;
+        for (uint32_t i = first[t]; ok && (i != head[t]); i++) {
+            const Event& event = rings[t].events[i & (RINGSIZE - 1)];
+            if (event.phase == 'E') {
+                if (depth == 0) continue;
+                depth--;
+            } else if (event.phase == 'B') {
+                depth++;
+            }
+            ok = fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%u,\"pid\":0,\"tid\":%d%s}", event.name,
+                         event.phase, (unsigned)(event.ts - base), t, (event.phase == 'i') ? ",\"s\":\"t\"" : "") > 0;
+        }
+        ok = ok && (fputs((t < NUMTRACKS - 1) ? ",\n" : "\n", out) >= 0);
+    }
+    ok = ok && (fputs("]}\n", out) >= 0);
+
+    for (uint8_t t = 0; t < NUMTRACKS; t++) {
+        rings[t].exported = head[t];
+    }
+    enabled = true;
+    return ok;
+}
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Config.hpp"
+
+#if defined(USE_EVENTTRACE)
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include "esp_timer.h"
+
+// Begin/end events of the emulator tasks for the Chrome trace viewer resp. Perfetto. Each task records into its own
+// ring buffer (single writer, no locks), export() writes the most recent events of all tasks as Chrome trace JSON.
+// Event names must be string literals, only the pointer is stored.
+class EventTrace {
+   public:
+    enum Track : uint8_t { CPU, INPUT, DISPLAY, TIMER, SDCARD, NUMTRACKS };
+
+   private:
+    static const uint32_t RINGSIZE = 4096;  // events per track, power of 2
+
+    struct Event {
+        uint32_t    ts;  // esp_timer time in us, truncated
+        const char* name;
+        char        phase;  // 'B'egin, 'E'nd or 'i'nstant
+    };
+    struct Ring {
+        Event*                events;
+        std::atomic<uint32_t> head{0};      // number of events ever recorded, only written by the task of the track
+        uint32_t              exported{0};  // head at the last export, the next export starts there
+    };
+
+    static Ring              rings[NUMTRACKS];
+    static std::atomic<bool> enabled;
+
+   public:
+    static void init();
+
+    static inline void record(Track track, const char* name, char phase) __attribute__((always_inline))
+    {
+        if (!enabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        Ring&    ring  = rings[track];
+        uint32_t head  = ring.head.load(std::memory_order_relaxed);
+        Event&   event = ring.events[head & (RINGSIZE - 1)];
+        event.ts       = (uint32_t)esp_timer_get_time();
+        event.name     = name;
+        event.phase    = phase;
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    // Records a begin and an end event for the lifetime of the object
+    class Scope {
+       private:
+        Track       track;
+        const char* name;
+
+       public:
+        inline Scope(Track track, const char* name) __attribute__((always_inline)) : track(track), name(name)
+        {
+            record(track, name, 'B');
+        }
+        inline ~Scope() __attribute__((always_inline))
+        {
+            record(track, name, 'E');
+        }
+    };
+
+    // Write the events recorded since the last export as JSON, recording is paused meanwhile. Returns false on write
+    // errors.
+    static bool exportJson(FILE* out);
+};
+
+#define TRACE_INIT()                EventTrace::init()
+#define TRACE_BEGIN(track, name)    EventTrace::record(EventTrace::track, name, 'B')
+#define TRACE_END(track, name)      EventTrace::record(EventTrace::track, name, 'E')
+#define TRACE_INSTANT(track, name)  EventTrace::record(EventTrace::track, name, 'i')
+#define TRACE_SCOPE(track, name)    EventTrace::Scope traceScope(EventTrace::track, name)
+#else
+#define TRACE_INIT()
+#define TRACE_BEGIN(track, name)
+#define TRACE_END(track, name)
+#define TRACE_INSTANT(track, name)
+#define TRACE_SCOPE(track, name)
+#endif
@@ -25,6 +25,14 @@
 
 static const char* TAG = "ExternalCmds";
 
+// how long the run/stop key of restore + run/stop is held
+static const uint32_t RUNSTOPHOLDMS = 100;
+
+// screen editor loop waiting for a key, reached when the KERNAL has booted, and the longest wait for it (frames)
+static const uint16_t KERNAL_WAITKEY_START = 0xe5cd;
+static const uint16_t KERNAL_WAITKEY_END   = 0xe5d5;
+static const uint16_t RESETMAXFRAMES       = 250;
+
 enum class ExternalCmds::ExtCmd {
     NOEXTCMD                = 0,
     JOYSTICKMODE1           = 1,
@@ -48,7 +56,10 @@ enum class ExternalCmds::ExtCmd {
     GETBATTERYVOLTAGE       = 29,
     POWEROFF                = 30,
     SAVE                    = 31,
-    LIST                    = 32
+    LIST                    = 32,
+    BREAKPOINT              = 33,
+    WATCHPOINT              = 34,
+    CONTINUE                = 35
 };
 
 void ExternalCmds::init(uint8_t* ram, C64Emu* c64emu) {
@@ -60,9 +71,8 @@ void ExternalCmds::init(uint8_t* ram, C64Emu* c64emu) {
     sendrawkeycodes = false;
     liststartflag   = true;
 
-    // Setup SDCard
-    // TODO: implement detection of insert and remove SD card
-    sdcard.init();
+    // Setup SDCard, mounted in the background
+    sdcard.start();
 }
 
 void ExternalCmds::setType1Notification() {
@@ -122,16 +132,16 @@ void ExternalCmds::setVarTab(uint16_t addr) {
     c64emu->cpu.setPC(0xa52a);
 }
 
+// Load a PRG from the PRG directory, a mounted disk image is ejected so that LOAD finds the PRG files again
 bool ExternalCmds::loadPrg(const char* filename) {
     ESP_LOGI(TAG, "load from sdcard...");
-    c64emu->cpu.cpuhalted = true;
-    bool     fileloaded   = false;
-    bool     error        = false;
+    bool     fileloaded = false;
+    bool     error      = false;
     uint16_t addr;
-    if (sdcard.init()) {
+    ejectD64();
+    if (sdcard.isReady()) {
         std::string full_name = (std::string("/") + filename + ".prg").c_str();
-        addr                  = sdcard.load(full_name.c_str(), ram);
-        if (addr == 0) {
+        if (!sdcard.load(full_name.c_str(), ram, addr)) {
             ESP_LOGI(TAG, "file not found %s", full_name.c_str());
         } else {
             setVarTab(addr);
@@ -141,7 +151,120 @@ bool ExternalCmds::loadPrg(const char* filename) {
         error = true;
         ESP_LOGI(TAG, "error init sdcard");
     }
-    addr = src_loadactions_prg[0] + (src_loadactions_prg[1] << 8);
+    showLoadResult(fileloaded, error);
+    return fileloaded;
+}
+
+// Mount a disk image from the PRG directory and load its first program like LOAD"*",8
+bool ExternalCmds::mountD64(const char* filename) {
+    ESP_LOGI(TAG, "mount disk image...");
+    bool fileloaded = false;
+    bool error      = false;
+    if (sdcard.isReady()) {
+        std::string    full_name = std::string(SD_CARD_PRG_PATH) + "/" + filename + ".d64";
+        size_t         size;
+        const uint8_t* data = sdcard.readFile(full_name.c_str(), size);
+        if ((data != nullptr) && disk.mount(full_name.c_str(), data, size)) {
+            uint16_t addr;
+            if (loadFromDisk("*", addr)) {
+                setVarTab(addr);
+                fileloaded = true;
+            }
+        } else {
+            error = true;
+        }
+    } else {
+        error = true;
+        ESP_LOGI(TAG, "error init sdcard");
+    }
+    showLoadResult(fileloaded, error);
+    return fileloaded;
+}
+
+// Load from the mounted disk image, "$" loads the directory. Returns false if not found.
+bool ExternalCmds::loadFromDisk(const char* name, uint16_t& endaddr) {
+    if (strcmp(name, "$") == 0) {
+        return disk.loadDirectory(ram, endaddr, 0x0801);
+    }
+    int index = disk.find(name);
+    if (index < 0) {
+        ESP_LOGI(TAG, "file not found on disk: %s", name);
+        return false;
+    }
+    return disk.load(index, ram, endaddr);
+}
+
+void ExternalCmds::ejectD64() {
+    if (disk.isMounted()) {
+        ESP_LOGI(TAG, "eject disk image");
+        disk.unmount();
+    }
+}
+
+// KERNAL error codes
+static const uint8_t KERNAL_ERR_FILE_NOT_FOUND     = 4;
+static const uint8_t KERNAL_ERR_DEVICE_NOT_PRESENT = 5;
+static const uint8_t KERNAL_ERR_MISSING_FILENAME   = 8;
+
+// skip the "@" (replace) and drive number prefixes of CBM DOS file names, e.g. "@0:name"
+static const char* stripDrive(const char* name) {
+    if (*name == '@') name++;
+    const char* colon = strchr(name, ':');
+    return (colon != nullptr) ? colon + 1 : name;
+}
+
+uint8_t ExternalCmds::kernalLoad(const char* name, uint8_t secondary, uint16_t addr, uint16_t& endaddr) {
+    // secondary address 0 loads to the given address, otherwise to the address of the file
+    int32_t loadaddr = (secondary == 0) ? addr : -1;
+    name             = stripDrive(name);
+    if (*name == '\0') {
+        return KERNAL_ERR_MISSING_FILENAME;
+    }
+    if (disk.isMounted()) {
+        bool loaded = (strcmp(name, "$") == 0)
+                          ? disk.loadDirectory(ram, endaddr, (loadaddr >= 0) ? loadaddr : 0x0401)
+                          : disk.load(disk.find(name), ram, endaddr, loadaddr);
+        return loaded ? 0 : KERNAL_ERR_FILE_NOT_FOUND;
+    } else if (sdcard.isReady()) {
+        // a trailing '*' loads the first PRG file starting with the given name
+        std::string filename = name;
+        if ((filename.back() == '*') && !sdcard.findPrg(filename.substr(0, filename.size() - 1).c_str(), filename)) {
+            return KERNAL_ERR_FILE_NOT_FOUND;
+        }
+        if (!sdcard.load(("/" + filename + ".prg").c_str(), ram, endaddr, loadaddr)) {
+            return KERNAL_ERR_FILE_NOT_FOUND;
+        }
+        return 0;
+    }
+    return KERNAL_ERR_DEVICE_NOT_PRESENT;
+}
+
+// Saves always go to the PRG directory, also when a disk image is mounted. The data is written in the background,
+// so the KERNAL gets success as soon as the save is queued, a failed write is only logged.
+uint8_t ExternalCmds::kernalSave(const char* name, uint16_t start, uint16_t end) {
+    name = stripDrive(name);
+    if (*name == '\0') {
+        return KERNAL_ERR_MISSING_FILENAME;
+    }
+    std::string filename(name);
+    if (!sdcard.postSave(name, ram, start, end, [filename](bool ok) {
+            if (!ok) ESP_LOGE(TAG, "saving %s failed", filename.c_str());
+        })) {
+        return KERNAL_ERR_DEVICE_NOT_PRESENT;
+    }
+    return 0;
+}
+
+// Print the result of a save with the saveactions routine
+void ExternalCmds::showSaveResult(bool filesaved) {
+    uint16_t addr = src_saveactions_prg[0] + (src_saveactions_prg[1] << 8);
+    memcpy(ram + addr, src_saveactions_prg + 2, src_saveactions_prg_len - 2);
+    c64emu->cpu.exeSubroutine(addr, filesaved ? 1 : 0, 0, 0);
+}
+
+// Print the result of a load with the loadactions routine
+void ExternalCmds::showLoadResult(bool fileloaded, bool error) {
+    uint16_t addr = src_loadactions_prg[0] + (src_loadactions_prg[1] << 8);
     memcpy(ram + addr, src_loadactions_prg + 2, src_loadactions_prg_len - 2);
     if (fileloaded) {
         c64emu->cpu.exeSubroutine(addr, 1, 0, 0);
@@ -150,18 +273,150 @@ bool ExternalCmds::loadPrg(const char* filename) {
     } else {
         c64emu->cpu.exeSubroutine(addr, 0, 0, 0);
     }
-    c64emu->cpu.cpuhalted = false;
-    return 0;
 }
 
+// Reset the C64, like switching it off and on this also ejects the disk image
 void ExternalCmds::reset() {
+    ejectD64();
     if (c64emu != nullptr) {
-            c64emu->cpu.cpuhalted = true;
-            c64emu->cpu.initMemAndRegs();
-            c64emu->cpu.vic->initVarsAndRegs();
-            c64emu->cpu.cia1.init(true);
-            c64emu->cpu.cia2.init(false);
-            c64emu->cpu.cpuhalted = false;
+        c64emu->cpu.initMemAndRegs();
+        c64emu->cpu.vic->initVarsAndRegs();
+        c64emu->cpu.cia1.init(true);
+        c64emu->cpu.cia2.init(false);
+        // also leaves a halted (jammed) cpu
+        c64emu->cpu.cpuhalted = false;
+    }
+}
+
+bool ExternalCmds::postExternalCmd(const uint8_t* buffer, size_t len, std::function<void(uint8_t)> onDone) {
+    ExtCmdRequest request;
+    request.type   = ExtCmdRequest::Type::EXTCMD;
+    request.onDone = onDone;
+    memset(request.data, 0, sizeof(request.data));
+    memcpy(request.data, buffer, len < sizeof(request.data) ? len : sizeof(request.data));
+    return mailbox.push(request);
+}
+
+bool ExternalCmds::postLoadPrg(const char* filename, bool afterReset, std::function<void(uint8_t)> onDone) {
+    ExtCmdRequest request;
+    request.type       = ExtCmdRequest::Type::LOADPRG;
+    request.afterReset = afterReset;
+    request.onDone     = onDone;
+    strlcpy(reinterpret_cast<char*>(request.data), filename, sizeof(request.data));
+    return mailbox.push(request);
+}
+
+bool ExternalCmds::postMountD64(const char* filename, bool afterReset, std::function<void(uint8_t)> onDone) {
+    ExtCmdRequest request;
+    request.type       = ExtCmdRequest::Type::MOUNTD64;
+    request.afterReset = afterReset;
+    request.onDone     = onDone;
+    strlcpy(reinterpret_cast<char*>(request.data), filename, sizeof(request.data));
+    return mailbox.push(request);
+}
+
+bool ExternalCmds::postReset(std::function<void(uint8_t)> onDone) {
+    ExtCmdRequest request;
+    request.type   = ExtCmdRequest::Type::RESET;
+    request.onDone = onDone;
+    return mailbox.push(request);
+}
+
+bool ExternalCmds::postEjectD64(std::function<void(uint8_t)> onDone) {
+    ExtCmdRequest request;
+    request.type   = ExtCmdRequest::Type::EJECTD64;
+    request.onDone = onDone;
+    return mailbox.push(request);
+}
+
+#if defined(USE_DEBUGGER)
+bool ExternalCmds::postContinue(std::function<void(uint8_t)> onDone) {
+    uint8_t buffer[1] = {static_cast<uint8_t>(ExtCmd::CONTINUE)};
+    return postExternalCmd(buffer, sizeof(buffer), onDone);
+}
+
+// The commands use the protocol of the BREAKPOINT / WATCHPOINT external commands
+bool ExternalCmds::postBreakpoint(bool set, uint16_t addr, std::function<void(uint8_t)> onDone) {
+    uint8_t buffer[5] = {static_cast<uint8_t>(ExtCmd::BREAKPOINT), (uint8_t)(set ? 1 : 0), 0, (uint8_t)(addr & 0xff),
+                         (uint8_t)(addr >> 8)};
+    return postExternalCmd(buffer, sizeof(buffer), onDone);
+}
+
+bool ExternalCmds::postWatchpoint(bool set, uint16_t from, uint16_t to, bool read, bool write,
+                                  std::function<void(uint8_t)> onDone) {
+    uint8_t buffer[8] = {static_cast<uint8_t>(ExtCmd::WATCHPOINT),
+                         (uint8_t)(set ? 1 : 0),
+                         0,
+                         (uint8_t)(from & 0xff),
+                         (uint8_t)(from >> 8),
+                         (uint8_t)(to & 0xff),
+                         (uint8_t)(to >> 8),
+                         (uint8_t)((read ? 1 : 0) | (write ? 2 : 0))};
+    return postExternalCmd(buffer, sizeof(buffer), onDone);
+}
+
+bool ExternalCmds::postClearDebugPoints(std::function<void(uint8_t)> onDone) {
+    uint8_t buffer[2] = {static_cast<uint8_t>(ExtCmd::BREAKPOINT), 2};
+    return postExternalCmd(buffer, sizeof(buffer), onDone);
+}
+#endif
+
+// The KERNAL has booted when the screen editor waits for a key ($e5cd - $e5d5)
+bool ExternalCmds::kernalReady() {
+    uint16_t pc = c64emu->cpu.getPC();
+    return (pc >= KERNAL_WAITKEY_START) && (pc <= KERNAL_WAITKEY_END);
+}
+
+void ExternalCmds::runRequest(ExtCmdRequest& request) {
+    uint8_t result = 0;
+    switch (request.type) {
+        case ExtCmdRequest::Type::EXTCMD:
+            result = executeExternalCmd(request.data);
+            break;
+        case ExtCmdRequest::Type::LOADPRG:
+            result = loadPrg(reinterpret_cast<const char*>(request.data));
+            break;
+        case ExtCmdRequest::Type::MOUNTD64:
+            result = mountD64(reinterpret_cast<const char*>(request.data));
+            break;
+        case ExtCmdRequest::Type::RESET:
+            reset();
+            break;
+        case ExtCmdRequest::Type::EJECTD64:
+            ejectD64();
+            break;
+    }
+    if (request.onDone) {
+        request.onDone(result);
+    }
+}
+
+// Called by the CPU task between two frames, so commands can safely change the C64 state. A command after a reset
+// holds back the following ones until the KERNAL is ready.
+void ExternalCmds::drainCommands() {
+    sdcard.pollSaves();
+    if (!sdcard.isReady()) {
+        // the image belongs to the removed card
+        ejectD64();
+    }
+    if (deferredPending) {
+        if (!kernalReady() && (++deferredFrames < RESETMAXFRAMES)) {
+            return;
+        }
+        deferredPending = false;
+        runRequest(deferred);
+        deferred = ExtCmdRequest();
+    }
+    ExtCmdRequest request;
+    while (mailbox.pop(request)) {
+        if (request.afterReset) {
+            reset();
+            deferred        = request;
+            deferredPending = true;
+            deferredFrames  = 0;
+            return;
+        }
+        runRequest(request);
     }
 }
 
@@ -172,13 +427,19 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
             return 0;
         case ExtCmd::LOAD: {
             ESP_LOGI(TAG, "load from sdcard...");
-            c64emu->cpu.cpuhalted = true;
-            bool     fileloaded   = false;
-            bool     error        = false;
+            bool     fileloaded = false;
+            bool     error      = false;
             uint16_t addr;
-            if (sdcard.init()) {
-                addr = sdcard.load_auto(SD_CARD_PRG_PATH, ram);
-                if (addr == 0) {
+            if (disk.isMounted()) {
+                // a mounted disk image replaces the PRG directory
+                char name[17];
+                getScreenName(name, ram);
+                if (loadFromDisk(name, addr)) {
+                    setVarTab(addr);
+                    fileloaded = true;
+                }
+            } else if (sdcard.isReady()) {
+                if (!sdcard.load_auto(SD_CARD_PRG_PATH, ram, addr)) {
                     ESP_LOGI(TAG, "file not found");
                 } else {
                     setVarTab(addr);
@@ -188,44 +449,26 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
                 error = true;
                 ESP_LOGI(TAG, "error init sdcard");
             }
-            addr = src_loadactions_prg[0] + (src_loadactions_prg[1] << 8);
-            memcpy(ram + addr, src_loadactions_prg + 2, src_loadactions_prg_len - 2);
-            if (fileloaded) {
-                c64emu->cpu.exeSubroutine(addr, 1, 0, 0);
-            } else if (error) {
-                c64emu->cpu.exeSubroutine(addr, 0, 1, 0);
-            } else {
-                c64emu->cpu.exeSubroutine(addr, 0, 0, 0);
-            }
-            c64emu->cpu.cpuhalted = false;
+            showLoadResult(fileloaded, error);
             return 0;
         }
         case ExtCmd::SAVE: {
             ESP_LOGI(TAG, "save to sdcard...");
-            c64emu->cpu.cpuhalted = true;
-            bool filesaved        = false;
-            if (sdcard.init()) {
-                filesaved = sdcard.save(SD_CARD_PRG_PATH, const_cast<uint8_t*>(ram));
-                if (!filesaved) {
-                    ESP_LOGI(TAG, "error saving file");
-                }
-            } else {
-                ESP_LOGI(TAG, "error init sdcard");
+            // the program is copied and written by the SD task, the result is shown when the write is done
+            char     name[17];
+            uint16_t startaddr = ram[43] + ram[44] * 256;
+            uint16_t endaddr   = ram[45] + ram[46] * 256;
+            getScreenName(name, ram);
+            if ((name[0] == '\0') ||
+                !sdcard.postSave(name, ram, startaddr, endaddr, [this](bool ok) { showSaveResult(ok); })) {
+                ESP_LOGI(TAG, "error saving file");
+                showSaveResult(false);
             }
-            uint16_t addr = src_saveactions_prg[0] + (src_saveactions_prg[1] << 8);
-            memcpy(ram + addr, src_saveactions_prg + 2, src_saveactions_prg_len - 2);
-            if (filesaved) {
-                c64emu->cpu.exeSubroutine(addr, 1, 0, 0);
-            } else {
-                c64emu->cpu.exeSubroutine(addr, 0, 0, 0);
-            }
-            c64emu->cpu.cpuhalted = false;
             return 0;
         }
         case ExtCmd::LIST: {
             ESP_LOGI(TAG, "list sdcard...");
-            c64emu->cpu.cpuhalted = true;
-            if (sdcard.init()) {
+            if (sdcard.isReady()) {
                 uint16_t addr = src_listactions_prg[0] + (src_listactions_prg[1] << 8);
                 memcpy(ram + addr, src_listactions_prg + 2, src_listactions_prg_len - 2);
                 if (liststartflag) {
@@ -257,12 +500,10 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
             } else {
                 ESP_LOGI(TAG, "error init sdcard");
             }
-            c64emu->cpu.cpuhalted = false;
             return 0;
         }
         case ExtCmd::RECEIVEDATA: {
             ESP_LOGI(TAG, "enter receivedata");
-            c64emu->cpu.cpuhalted = true;
             // simple "protocol":
             // - byte 0: cmd (as usual)
             // - byte 1: cmd detail: first block (1), next block (0), last block (2)
@@ -270,7 +511,7 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
             // - first block: byte 3 - 4: start address, 5 - 252: data
             // - next block: byte 3 - 252: data
             // - last block: byte 3: length of last block, byte 4 - (length+4-1): data
-            uint8_t cmddetail     = buffer[1];
+            uint8_t cmddetail = buffer[1];
             if (cmddetail == 0) {
                 // next block
                 ESP_LOGI(TAG, "next block: %x", actaddrreceivecmd);
@@ -297,7 +538,6 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
                 actaddrreceivecmd += len;
                 setVarTab(actaddrreceivecmd);
             }
-            c64emu->cpu.cpuhalted = false;
             ESP_LOGI(TAG, "leave receivedata");
             setType4Notification();
             return 4;
@@ -306,7 +546,7 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
             if (buffer[1] == 1) {
                 // restore + run/stop
                 c64emu->cpu.setMem(0xdc00, 0);
-                c64emu->cpu.setKeycodes(0x7f, 0);
+                c64emu->cpu.setKeycodes(0x7f, 0x7f, RUNSTOPHOLDMS);
             }
             c64emu->cpu.restorenmi = true;
             return 0;
@@ -326,7 +566,7 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
             return 2;
         case ExtCmd::SHOWMEM: {
             uint16_t addr              = buffer[3] + (buffer[4] << 8);
-            // use addr also as debugging start address
+            // use addr also as trigger address of the instruction trace
             c64emu->cpu.debugstartaddr = addr;
             ESP_LOGI(TAG, "addr: %x", addr);
             setType3Notification(addr);
@@ -340,22 +580,17 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
             return 3;
         }
         case ExtCmd::RESET:
-            c64emu->cpu.cpuhalted = true;
-            c64emu->cpu.initMemAndRegs();
-            c64emu->cpu.vic->initVarsAndRegs();
-            c64emu->cpu.cia1.init(true);
-            c64emu->cpu.cia2.init(false);
-            c64emu->cpu.cpuhalted = false;
+            reset();
             return 0;
         case ExtCmd::JOYSTICKMODE1:
-            c64emu->cpu.joystickmode   = 1;
-            c64emu->cpu.kbjoystickmode = 0;
+            c64emu->cpu.joystickmode = 1;
+            c64emu->konsoolkb.requestKbJoystickPort(0);
             ESP_LOGI(TAG, "joystickmode = %x", c64emu->cpu.joystickmode);
             setType1Notification();
             return 1;
         case ExtCmd::JOYSTICKMODE2:
-            c64emu->cpu.joystickmode   = 2;
-            c64emu->cpu.kbjoystickmode = 0;
+            c64emu->cpu.joystickmode = 2;
+            c64emu->konsoolkb.requestKbJoystickPort(0);
             ESP_LOGI(TAG, "joystickmode = %x", c64emu->cpu.joystickmode);
             setType1Notification();
             return 1;
@@ -365,18 +600,18 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
             setType1Notification();
             return 1;
         case ExtCmd::KBJOYSTICKMODE1:
-            c64emu->cpu.kbjoystickmode = 1;
-            c64emu->cpu.joystickmode   = 0;
-            ESP_LOGI(TAG, "kbjoystickmode = %x", c64emu->cpu.kbjoystickmode);
+            c64emu->konsoolkb.requestKbJoystickPort(1);
+            c64emu->cpu.joystickmode = 0;
+            ESP_LOGI(TAG, "kbjoystickmode = 1");
             return 0;
         case ExtCmd::KBJOYSTICKMODE2:
-            c64emu->cpu.kbjoystickmode = 2;
-            c64emu->cpu.joystickmode   = 0;
-            ESP_LOGI(TAG, "kbjoystickmode = %x", c64emu->cpu.kbjoystickmode);
+            c64emu->konsoolkb.requestKbJoystickPort(2);
+            c64emu->cpu.joystickmode = 0;
+            ESP_LOGI(TAG, "kbjoystickmode = 2");
             return 0;
         case ExtCmd::KBJOYSTICKMODEOFF:
-            c64emu->cpu.kbjoystickmode = 0;
-            ESP_LOGI(TAG, "kbjoystickmode = %x", c64emu->cpu.kbjoystickmode);
+            c64emu->konsoolkb.requestKbJoystickPort(0);
+            ESP_LOGI(TAG, "kbjoystickmode = 0");
             return 0;
         case ExtCmd::GETSTATUS:
             // just send type 1 notification
@@ -394,8 +629,7 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
             setType1Notification();
             return 1;
         case ExtCmd::SWITCHDEBUG:
-            c64emu->cpu.debug            = !c64emu->cpu.debug;
-            c64emu->cpu.debuggingstarted = false;
+            c64emu->cpu.setDebug(!c64emu->cpu.debug);
             ESP_LOGI(TAG, "debug = %x", c64emu->cpu.debug);
             setType1Notification();
             return 1;
@@ -419,6 +653,42 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t* buffer) {
             c64emu->powerOff();
             return 0;
         }
+#if defined(USE_DEBUGGER)
+        case ExtCmd::BREAKPOINT:
+        case ExtCmd::WATCHPOINT: {
+            // simple "protocol":
+            // - byte 0: cmd (as usual)
+            // - byte 1: cmd detail: clear (0), set (1), clear all breakpoints and watchpoints (2)
+            // - byte 2: cmd flag (as usual)
+            // - byte 3 - 4: address resp. first address of the watched range
+            // - watchpoint: byte 5 - 6: last address of the watched range (0 = first address), byte 7: read (1),
+            //   write (2) or both (3)
+            uint8_t  cmddetail = buffer[1];
+            uint16_t from      = buffer[3] + (buffer[4] << 8);
+            uint16_t to        = from;
+            uint8_t  flag      = Debugger::BREAK;
+            if (cmd == ExtCmd::WATCHPOINT) {
+                uint16_t last = buffer[5] + (buffer[6] << 8);
+                if (last > from) {
+                    to = last;
+                }
+                flag = ((buffer[7] & 1) ? Debugger::READ : 0) | ((buffer[7] & 2) ? Debugger::WRITE : 0);
+            }
+            if (cmddetail == 0) {
+                c64emu->cpu.debugger.clear(from, to, flag);
+            } else if (cmddetail == 1) {
+                c64emu->cpu.debugger.set(from, to, flag);
+            } else if (cmddetail == 2) {
+                c64emu->cpu.debugger.clearAll();
+            }
+            ESP_LOGI(TAG, "%s %x - %x, flag = %x, detail = %x",
+                     (cmd == ExtCmd::WATCHPOINT) ? "watchpoint" : "breakpoint", from, to, flag, cmddetail);
+            return 0;
+        }
+        case ExtCmd::CONTINUE:
+            c64emu->cpu.continueDebug();
+            return 0;
+#endif
 #ifdef BOARD_T_HMI
         case ExtCmd::POWEROFF:
             c64emu->powerOff();
@@ -20,6 +20,10 @@
 class C64Emu;
 
 #include <cstdint>
+#include <functional>
+#include "Config.hpp"
+#include "D64Image.hpp"
+#include "Mailbox.hpp"
 #include "SDCard.hpp"
 
 // notifications may be not larger than 20 bytes
@@ -72,6 +76,17 @@ struct BLENotificationStruct5 {
     uint8_t batteryVolHi;
 };
 
+// Command for the CPU task, onDone is called on the CPU task with the result of the command. With afterReset the C64
+// is reset first and the command is carried out once the KERNAL has booted.
+struct ExtCmdRequest {
+    enum class Type : uint8_t { EXTCMD, LOADPRG, MOUNTD64, RESET, EJECTD64 };
+
+    Type                         type       = Type::EXTCMD;
+    bool                         afterReset = false;
+    uint8_t                      data[256];  // external command buffer or file name
+    std::function<void(uint8_t)> onDone;
+};
+
 class ExternalCmds {
    private:
     C64Emu*  c64emu;
@@ -81,7 +96,20 @@ class ExternalCmds {
 
     bool initialized = false;
 
-    void setVarTab(uint16_t addr);
+    // commands from the UI task, executed by the CPU task at the end of a frame
+    Mailbox<ExtCmdRequest, 8> mailbox;
+    // command waiting for the KERNAL to boot after its reset, and the number of frames waited
+    ExtCmdRequest deferred;
+    bool          deferredPending = false;
+    uint16_t      deferredFrames  = 0;
+
+    uint8_t  executeExternalCmd(uint8_t* buffer);
+    void     runRequest(ExtCmdRequest& request);
+    bool     kernalReady();
+    void     setVarTab(uint16_t addr);
+    void     showLoadResult(bool fileloaded, bool error);
+    void     showSaveResult(bool filesaved);
+    bool     loadFromDisk(const char* name, uint16_t& endaddr);
     void setType1Notification();
     void setType2Notification();
     void setType3Notification(uint16_t addr);
@@ -90,6 +118,7 @@ class ExternalCmds {
 
    public:
     SDCard   sdcard;
+    D64Image disk;
     // TODO: Doesn't work need to look at later
     enum class ExtCmd;
 
@@ -101,8 +130,36 @@ class ExternalCmds {
     BLENotificationStruct4 type4notification;
     BLENotificationStruct5 type5notification;
 
-    void    init(uint8_t* ram, C64Emu* c64emu);
+    void init(uint8_t* ram, C64Emu* c64emu);
+
+    // Producer side of the mailbox, return false if it is full. Only one task may post: the input task (menu), or the
+    // BLE task on boards with BLEKB instead of the Konsool keyboard.
+    bool postExternalCmd(const uint8_t* buffer, size_t len, std::function<void(uint8_t)> onDone = nullptr);
+    // afterReset: reset the C64 and load resp. mount once the KERNAL is ready
+    bool postLoadPrg(const char* filename, bool afterReset, std::function<void(uint8_t)> onDone = nullptr);
+    bool postMountD64(const char* filename, bool afterReset, std::function<void(uint8_t)> onDone = nullptr);
+    bool postReset(std::function<void(uint8_t)> onDone = nullptr);
+    bool postEjectD64(std::function<void(uint8_t)> onDone = nullptr);
+#if defined(USE_DEBUGGER)
+    // continue a cpu halted by a breakpoint or watchpoint
+    bool postContinue(std::function<void(uint8_t)> onDone = nullptr);
+    // set resp. clear the breakpoint at addr
+    bool postBreakpoint(bool set, uint16_t addr, std::function<void(uint8_t)> onDone = nullptr);
+    // set resp. clear read and / or write watchpoints for the addresses from to to (inclusive)
+    bool postWatchpoint(bool set, uint16_t from, uint16_t to, bool read, bool write,
+                        std::function<void(uint8_t)> onDone = nullptr);
+    // clear all breakpoints and watchpoints
+    bool postClearDebugPoints(std::function<void(uint8_t)> onDone = nullptr);
+#endif
+
+    // KERNAL LOAD / SAVE of device 8, return 0 or a KERNAL error code (CPU task only)
+    uint8_t kernalLoad(const char* name, uint8_t secondary, uint16_t addr, uint16_t& endaddr);
+    uint8_t kernalSave(const char* name, uint16_t start, uint16_t end);
+
+    // CPU task only
+    void    drainCommands();
     bool    loadPrg(const char* filename);
+    bool    mountD64(const char* filename);
+    void    ejectD64();
     void    reset();
-    uint8_t executeExternalCmd(uint8_t* buffer);
 };
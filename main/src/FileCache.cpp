@@ -0,0 +1,124 @@
+#include "FileCache.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/unistd.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char* TAG = "FileCache";
+
+FileCache::FileCache(size_t capacity, size_t maxFileSize) : capacity(capacity), maxFileSize(maxFileSize)
+{
+}
+
+FileCache::~FileCache()
+{
+    for (Entry& entry : entries) {
+        heap_caps_free(entry.data);
+    }
+}
+
+void FileCache::remove(size_t i)
+{
+    cachedBytes.fetch_sub(entries[i].size, std::memory_order_relaxed);
+    heap_caps_free(entries[i].data);
+    entries[i] = entries.back();
+    entries.pop_back();
+}
+
+const uint8_t* FileCache::get(const char* path, size_t& size)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        invalidate(path);
+        return nullptr;
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].path != path) {
+            continue;
+        }
+        if ((entries[i].mtime == st.st_mtime) && (entries[i].size == (size_t)st.st_size)) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            entries[i].lastUse = ++useCounter;
+            size               = entries[i].size;
+            return entries[i].data;
+        }
+        remove(i);  // changed on the card
+        break;
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    if ((size_t)st.st_size > maxFileSize) {
+        ESP_LOGE(TAG, "%s is too large (%d bytes)", path, (int)st.st_size);
+        return nullptr;
+    }
+
+    // make room by dropping the least recently used files
+    size_t used = cachedBytes.load(std::memory_order_relaxed);
+    while (!entries.empty() && (used + st.st_size > capacity)) {
+        size_t lru = 0;
+        for (size_t i = 1; i < entries.size(); i++) {
+            if (entries[i].lastUse < entries[lru].lastUse) lru = i;
+        }
+        used -= entries[lru].size;
+        remove(lru);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    uint8_t* data = (uint8_t*)heap_caps_malloc(st.st_size ? st.st_size : 1, MALLOC_CAP_SPIRAM);
+    if (data == nullptr) {
+        ESP_LOGE(TAG, "no memory for %s", path);
+        close(fd);
+        return nullptr;
+    }
+    size_t pos = 0;
+    while (pos < (size_t)st.st_size) {
+        ssize_t n = read(fd, data + pos, st.st_size - pos);
+        if (n <= 0) break;
+        pos += n;
+    }
+    close(fd);
+    if (pos != (size_t)st.st_size) {
+        ESP_LOGE(TAG, "error reading %s", path);
+        heap_caps_free(data);
+        return nullptr;
+    }
+
+    Entry entry;
+    entry.path    = path;
+    entry.mtime   = st.st_mtime;
+    entry.size    = st.st_size;
+    entry.data    = data;
+    entry.lastUse = ++useCounter;
+    entries.push_back(entry);
+    cachedBytes.fetch_add(entry.size, std::memory_order_relaxed);
+    size = entry.size;
+    return data;
+}
+
+void FileCache::invalidate(const char* path)
+{
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].path == path) {
+            remove(i);
+            return;
+        }
+    }
+}
+
+void FileCache::clear()
+{
+    while (!entries.empty()) {
+        remove(entries.size() - 1);
+    }
+}
+
+bool FileCache::takeStats(uint32_t& hits, uint32_t& misses, uint32_t& bytes)
+{
+    hits   = this->hits.exchange(0, std::memory_order_relaxed);
+    misses = this->misses.exchange(0, std::memory_order_relaxed);
+    bytes  = cachedBytes.load(std::memory_order_relaxed);
+    return (hits + misses) != 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <time.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Size bounded LRU cache of whole files in PSRAM, keyed by path, mtime and size. Not thread safe except for
+// takeStats(): all other methods must be called from the same task.
+class FileCache {
+   private:
+    struct Entry {
+        std::string path;
+        time_t      mtime;
+        size_t      size;
+        uint8_t*    data;
+        uint32_t    lastUse;
+    };
+
+    std::vector<Entry> entries;
+    const size_t       capacity;
+    const size_t       maxFileSize;
+    uint32_t           useCounter = 0;
+
+    std::atomic<uint32_t> hits{0};
+    std::atomic<uint32_t> misses{0};
+    std::atomic<uint32_t> cachedBytes{0};
+
+    void remove(size_t i);
+
+   public:
+    FileCache(size_t capacity, size_t maxFileSize);
+    ~FileCache();
+    FileCache(const FileCache&)            = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    // Contents of a file, from the cache or read into it. Returns nullptr if the file can not be read or is too
+    // large. The data stays valid until the next call of get() or invalidate().
+    const uint8_t* get(const char* path, size_t& size);
+
+    // Drop a file that was changed resp. all files
+    void invalidate(const char* path);
+    void clear();
+
+    // Hits and misses since the last call and the number of cached bytes, returns false if there were no lookups
+    bool takeStats(uint32_t& hits, uint32_t& misses, uint32_t& bytes);
+};
@@ -30,7 +30,9 @@ extern "C" {
 }
 #ifdef USE_GFXP4
 #include "GfxP4.hpp"
+#include "EventTrace.hpp"
 #include "HardwareInitializationException.h"
+#include "Profiler.hpp"
 // #include <FreeRTOS.h>
 #include <driver/gpio.h>
 #include <soc/gpio_struct.h>
@@ -103,6 +105,13 @@ void GfxP4::init()
     };
     ESP_ERROR_CHECK(ppa_register_client(&ppa_fill_config, &ppa_fill_handle));
 
+#if defined(USE_PROFILER)
+    // Profiler HUD, drawn like the menu overlay
+    pax_buf_init(&hud, NULL, hud_width, hud_height, PAX_BUF_16_565RGB);
+    pax_buf_reversed(&hud, true);
+    pax_background(&hud, 0xff000000);
+#endif
+
     // Setup rotation and scale configuration
     // Initialize input configuration
     GfxP4::active_config.in.pic_w          = 320;
@@ -195,6 +204,8 @@ uint32_t GfxP4::rgb565ToRgb8888(uint16_t rgb565)
 
 void IRAM_ATTR GfxP4::drawFrame(uint16_t* frameColors)
 {
+    PROFILE_SCOPE(PPA);
+    TRACE_SCOPE(DISPLAY, "border");
 
     // Left bar
     // Use PPA to rotate and scale the bitmap to the display.
@@ -288,41 +299,80 @@ void GfxP4::drawMenuOverlay()
 
 void GfxP4::drawBitmap(uint16_t* bitmap)
 {
-    // Overlay the menu if enabled
-    if (menu_overlay_enabled) {
-        // Draw menu
-        drawMenuOverlay();
-    } else {
-        // Set bitmap to configuration.
-        active_config.in.buffer = bitmap;
-
-        // Use PPA to rotate and scale the bitmap to the display.
-        GfxP4::active_config.in.pic_w          = 320;
-        GfxP4::active_config.in.pic_h          = 200;
-        GfxP4::active_config.in.block_w        = 320;
-        GfxP4::active_config.in.block_h        = 200;
-        GfxP4::active_config.in.block_offset_x = 0;
-        GfxP4::active_config.in.block_offset_y = 0;
-
-        // Initialize output configuration
-        GfxP4::active_config.out.buffer         = raw_fb;
-        GfxP4::active_config.out.buffer_size    = display_h_res * display_v_res * 2;
-        GfxP4::active_config.out.pic_w          = display_h_res;
-        GfxP4::active_config.out.pic_h          = display_v_res;
-        GfxP4::active_config.out.block_offset_x = border_height;  // x_offset;
-        GfxP4::active_config.out.block_offset_y = border_width;   // y_offset;
-
-        // Initialize other configuration parameters
-        GfxP4::active_config.rotation_angle = PPA_SRM_ROTATION_ANGLE_270;
-        GfxP4::active_config.scale_x        = 2.0;
-        GfxP4::active_config.scale_y        = 2.0;
-        ESP_ERROR_CHECK(ppa_do_scale_rotate_mirror(ppa_srm_handle, &active_config));
+    {
+        PROFILE_SCOPE(PPA);
+        TRACE_SCOPE(DISPLAY, "ppa");
+        // Overlay the menu if enabled
+        if (menu_overlay_enabled) {
+            // Draw menu
+            drawMenuOverlay();
+        } else {
+            // Set bitmap to configuration.
+            active_config.in.buffer = bitmap;
+
+            // Use PPA to rotate and scale the bitmap to the display.
+            GfxP4::active_config.in.pic_w          = 320;
+            GfxP4::active_config.in.pic_h          = 200;
+            GfxP4::active_config.in.block_w        = 320;
+            GfxP4::active_config.in.block_h        = 200;
+            GfxP4::active_config.in.block_offset_x = 0;
+            GfxP4::active_config.in.block_offset_y = 0;
+
+            // Initialize output configuration
+            GfxP4::active_config.out.buffer         = raw_fb;
+            GfxP4::active_config.out.buffer_size    = display_h_res * display_v_res * 2;
+            GfxP4::active_config.out.pic_w          = display_h_res;
+            GfxP4::active_config.out.pic_h          = display_v_res;
+            GfxP4::active_config.out.block_offset_x = border_height;  // x_offset;
+            GfxP4::active_config.out.block_offset_y = border_width;   // y_offset;
+
+            // Initialize other configuration parameters
+            GfxP4::active_config.rotation_angle = PPA_SRM_ROTATION_ANGLE_270;
+            GfxP4::active_config.scale_x        = 2.0;
+            GfxP4::active_config.scale_y        = 2.0;
+            ESP_ERROR_CHECK(ppa_do_scale_rotate_mirror(ppa_srm_handle, &active_config));
+#if defined(USE_PROFILER)
+            if (Profiler::hudEnabled) {
+                drawHud();
+            }
+#endif
+        }
     }
 
     // Send the frame to the display over MIPI DSI.
+    PROFILE_SCOPE(DSI);
+    TRACE_SCOPE(DISPLAY, "dsi");
     ESP_ERROR_CHECK(esp_lcd_panel_draw_bitmap(display_lcd_panel, 0, 0, display_h_res, display_v_res, raw_fb));
 }
 
+#if defined(USE_PROFILER)
+// Profiler statistics in the corner of the C64 screen. The text only changes once per second, so it is only
+// rendered into the HUD buffer when there is a new report.
+void GfxP4::drawHud()
+{
+    uint32_t    generation;
+    const char* text = Profiler::getHudText(generation);
+    if (generation != hudGeneration) {
+        hudGeneration = generation;
+        pax_background(&hud, 0xff000000);
+        pax_draw_text(&hud, 0xffffffff, pax_font_sky_mono, 16, 4, 4, text);
+    }
+    active_config.in.buffer                 = (uint16_t*)hud.buf_16bpp;
+    GfxP4::active_config.in.pic_w           = hud_width;
+    GfxP4::active_config.in.pic_h           = hud_height;
+    GfxP4::active_config.in.block_w         = hud_width;
+    GfxP4::active_config.in.block_h         = hud_height;
+    GfxP4::active_config.in.block_offset_x  = 0;
+    GfxP4::active_config.in.block_offset_y  = 0;
+    GfxP4::active_config.out.block_offset_x = border_height;  // x_offset;
+    GfxP4::active_config.out.block_offset_y = border_width;   // y_offset;
+    GfxP4::active_config.scale_x            = 1.0;
+    GfxP4::active_config.scale_y            = 1.0;
+    GfxP4::active_config.rotation_angle     = PPA_SRM_ROTATION_ANGLE_270;
+    ESP_ERROR_CHECK(ppa_do_scale_rotate_mirror(ppa_srm_handle, &active_config));
+}
+#endif
+
 void GfxP4::enableMenuOverlay(bool enable)
 {
     menu_overlay_enabled = enable;
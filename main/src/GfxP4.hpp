@@ -80,6 +80,16 @@ class GfxP4 : public DisplayDriver {
 
     bool menu_overlay_enabled = true;
 
+#if defined(USE_PROFILER)
+    static const uint16_t hud_width  = 240;
+    static const uint16_t hud_height = 172;
+
+    pax_buf_t hud;
+    uint32_t  hudGeneration = 0;
+
+    void drawHud();
+#endif
+
     inline static void writeCmd(uint8_t cmd) __attribute__((always_inline));
     inline static void writeData(uint8_t data) __attribute__((always_inline));
     inline static void copyinit(uint16_t x0, uint16_t y0, uint16_t w, uint16_t h) __attribute__((always_inline));
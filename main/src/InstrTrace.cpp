@@ -0,0 +1,45 @@
+#include "InstrTrace.hpp"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char* TAG = "InstrTrace";
+
+InstrTrace::~InstrTrace()
+{
+    heap_caps_free(records);
+}
+
+bool InstrTrace::start()
+{
+    if (records == nullptr) {
+        // allocated on first use and kept
+        records = (Record*)heap_caps_malloc(SIZE * sizeof(Record), MALLOC_CAP_SPIRAM);
+        if (records == nullptr) {
+            ESP_LOGE(TAG, "no memory for instruction trace");
+            return false;
+        }
+    }
+    head   = 0;
+    frozen = nullptr;
+    return true;
+}
+
+void InstrTrace::dump(const char* const* names, size_t count)
+{
+    if (records == nullptr) {
+        return;
+    }
+    uint32_t available = (head < SIZE) ? head : SIZE;
+    if (count > available) {
+        count = available;
+    }
+    ESP_LOGI(TAG, "last %d of %d instructions%s%s", (int)count, (int)head, frozen ? ", stopped by " : "",
+             frozen ? frozen : "");
+    for (uint32_t i = head - count; i != head; i++) {
+        const Record& r = records[i & (SIZE - 1)];
+        ESP_LOGI(TAG, "%10u pc: %04x, cmd: %-14s a: %02x, x: %02x, y: %02x, sp: %02x, sr: %02x", (unsigned)r.cycle,
+                 r.pc, names[r.opcode], r.a, r.x, r.y, r.sp, r.sr);
+    }
+    head   = 0;
+    frozen = nullptr;
+}
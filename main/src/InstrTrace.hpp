@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary ring buffer of the last executed 6502 instructions. Recording is a few stores per instruction, so the CPU
+// runs at nearly full speed while tracing. The trace is frozen on a trigger (PC hit, CPU halt) and then dumped as text.
+// Must only be used by the CPU task.
+class InstrTrace {
+   public:
+    static const uint32_t SIZE = 16384;  // records, power of 2
+
+    struct Record {
+        uint32_t cycle;  // emulated cycle, truncated
+        uint16_t pc;
+        uint8_t  opcode;
+        uint8_t  a;
+        uint8_t  x;
+        uint8_t  y;
+        uint8_t  sp;
+        uint8_t  sr;
+    };
+
+   private:
+    Record*     records = nullptr;
+    uint32_t    head    = 0;  // number of records written
+    const char* frozen  = nullptr;
+
+   public:
+    InstrTrace() = default;
+    ~InstrTrace();
+    InstrTrace(const InstrTrace&)            = delete;
+    InstrTrace& operator=(const InstrTrace&) = delete;
+
+    // Start an empty trace, returns false if there is no memory for it
+    bool start();
+
+    inline void record(uint32_t cycle, uint16_t pc, uint8_t opcode, uint8_t a, uint8_t x, uint8_t y, uint8_t sp,
+                       uint8_t sr) __attribute__((always_inline))
+    {
+        Record& r = records[head++ & (SIZE - 1)];
+        r.cycle   = cycle;
+        r.pc      = pc;
+        r.opcode  = opcode;
+        r.a       = a;
+        r.x       = x;
+        r.y       = y;
+        r.sp      = sp;
+        r.sr      = sr;
+    }
+
+    // Stop recording because of reason, the trace is kept for dump()
+    void freeze(const char* reason)
+    {
+        frozen = reason;
+    }
+    bool isFrozen() const
+    {
+        return frozen != nullptr;
+    }
+
+    // Log the last count records (oldest first) with the opcode names and start over
+    void dump(const char* const* names, size_t count);
+};
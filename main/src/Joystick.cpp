@@ -23,8 +23,14 @@
 #include "Config.hpp"
 #include "JoystickInitializationException.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 
 void Joystick::init() {
+    value          = 0xff;
+    rawValue       = 0xff;
+    stableCnt      = DEBOUNCE_SAMPLES;
+    changeTime     = 0;
+    latencyPending = false;
 #ifdef USE_JOYSTICK
     // init gpio 
     gpio_config_t io_conf;
@@ -47,37 +53,66 @@ void Joystick::init() {
 #endif
 }
 
-uint8_t Joystick::getValue() {
-    int     valueL, valueR, valueU, valueD, valueFire = 0;
+// Read all joystick pins with a single register access. Called regularly by the CPU task, CIA reads return the
+// cached value.
+void Joystick::sample() {
+    uint8_t newValue = 0xff;
 #ifdef USE_JOYSTICK
-    valueL = gpio_get_level(Config::JOYSTICK_LEFT);
-    valueR = gpio_get_level(Config::JOYSTICK_RIGHT);
-    valueU = gpio_get_level(Config::JOYSTICK_UP);
-    valueD = gpio_get_level(Config::JOYSTICK_DOWN);
-    valueFire = gpio_get_level(Config::JOYSTICK_FIRE_PIN);
+    uint32_t in = GPIO.in.val;
+    if (!((in >> Config::JOYSTICK_LEFT) & 1)) {
+        newValue &= ~(1 << C64JOYLEFT);
+    } else if (!((in >> Config::JOYSTICK_RIGHT) & 1)) {
+        newValue &= ~(1 << C64JOYRIGHT);
+    }
+    if (!((in >> Config::JOYSTICK_DOWN) & 1)) {
+        newValue &= ~(1 << C64JOYDOWN);
+    } else if (!((in >> Config::JOYSTICK_UP) & 1)) {
+        newValue &= ~(1 << C64JOYUP);
+    }
+    if (!((in >> Config::JOYSTICK_FIRE_PIN) & 1)) {
+        newValue &= ~(1 << C64JOYFIRE);
+    }
 #endif
-    // C64 register value
-    uint8_t value = 0xff;
-    if (!valueL) {
-        value &= ~(1 << C64JOYLEFT);
-    } else if (!valueR) {
-        value &= ~(1 << C64JOYRIGHT);
+    if (newValue != rawValue) {
+        rawValue   = newValue;
+        stableCnt  = 1;
+        changeTime = esp_timer_get_time();
+    } else if (stableCnt < DEBOUNCE_SAMPLES) {
+        stableCnt++;
     }
-    if (!valueD) {
-        value &= ~(1 << C64JOYDOWN);
-    } else if (!valueU) {
-        value &= ~(1 << C64JOYUP);
+    if ((stableCnt >= DEBOUNCE_SAMPLES) && (rawValue != value)) {
+        value          = rawValue;
+        latencyPending = true;
     }
-    if (!valueFire) {
-        value &= ~(1 << C64JOYFIRE);
+}
+
+uint8_t Joystick::getValue() {
+    if (latencyPending) {
+        latencyPending = false;
+        latencies.push((uint32_t)(esp_timer_get_time() - changeTime));
     }
     return value;
 }
 
 bool Joystick::getFire2() {
-#if defined USE_JOYSTICK
-    return ((GPIO.in.val >> Config::JOYSTICK_FIRE_PIN) & 0x01) == 0;
-#else
-    return false;
-#endif
+    return !(value & (1 << C64JOYFIRE));
+}
+
+bool Joystick::takeLatencyStats(uint32_t &avgUs, uint32_t &maxUs) {
+    uint32_t latency;
+    uint32_t sum = 0;
+    uint32_t cnt = 0;
+    maxUs        = 0;
+    while (latencies.pop(latency)) {
+        sum += latency;
+        cnt++;
+        if (latency > maxUs) {
+            maxUs = latency;
+        }
+    }
+    if (cnt == 0) {
+        return false;
+    }
+    avgUs = sum / cnt;
+    return true;
 }
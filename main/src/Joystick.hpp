@@ -18,6 +18,7 @@
 #define JOYSTICK_H
 
 #include <stdint.h>
+#include "Mailbox.hpp"
 #include "esp_adc/adc_oneshot.h"
 // #include <cstdint>
 
@@ -28,8 +29,21 @@ private:
   static const uint16_t LEFT_THRESHOLD = 500;
   static const uint16_t RIGHT_THRESHOLD = 3500;
 
+  // a changed value must be seen in this many consecutive samples before it is used
+  static const uint8_t DEBOUNCE_SAMPLES = 2;
+
   adc_oneshot_unit_handle_t adc2_handle;
 
+  uint8_t value;       // debounced C64 register value
+  uint8_t rawValue;    // last sampled value
+  uint8_t stableCnt;   // number of samples rawValue has been seen
+  int64_t changeTime;  // time of the first sample of rawValue (us)
+  bool latencyPending; // value changed, but not yet read by the CPU
+
+  // input latency from the first sample of a change to the first read of the new value (us), measured by the CPU
+  // task and handed to takeLatencyStats(), samples are dropped while the mailbox is full
+  Mailbox<uint32_t, 16> latencies;
+
 public:
   static const uint8_t C64JOYUP = 0;
   static const uint8_t C64JOYDOWN = 1;
@@ -38,7 +52,9 @@ public:
   static const uint8_t C64JOYFIRE = 4;
 
   void init();
+  void sample();
   uint8_t getValue();
   bool getFire2();
+  bool takeLatencyStats(uint32_t &avgUs, uint32_t &maxUs);
 };
 #endif // JOYSTICK_H
@@ -22,8 +22,10 @@ extern "C" {
 }
 #include <cstdint>
 #include <cstring>
+#include "esp_timer.h"
 #include <konsoolled.hpp>
 #include "C64Emu.hpp"
+#include "EventTrace.hpp"
 #include "ExternalCmds.hpp"
 #include "Joystick.hpp"
 #include "KonsoolKB.hpp"
@@ -31,6 +33,22 @@ extern "C" {
 
 static const char* TAG = "KonsoolKB";
 
+// Menu actions (e.g. directory scans, trace export) run at KB_MENU_PRIO, so they don't hold up the display loop
+class KonsoolKB::MenuPriority {
+   private:
+    UBaseType_t saved;
+
+   public:
+    MenuPriority() : saved(uxTaskPriorityGet(NULL))
+    {
+        vTaskPrioritySet(NULL, KB_MENU_PRIO);
+    }
+    ~MenuPriority()
+    {
+        vTaskPrioritySet(NULL, saved);
+    }
+};
+
 KonsoolKB::KonsoolKB()
 {
     buffer = nullptr;
@@ -54,147 +72,101 @@ void KonsoolKB::init(C64Emu* c64emu)
     ESP_ERROR_CHECK(bsp_input_get_queue(&input_event_queue));
 
     // init buffer
-    buffer   = new uint8_t[256];
-    sentdc01 = 0xff;
-    sentdc00 = 0xff;
+    buffer = new uint8_t[256];
+    memset(keys_pressed, 0, sizeof(keys_pressed));
+    memset(keyCnt, 0, sizeof(keyCnt));
+    memset(matrix, 0xff, sizeof(matrix));
+    memset(publishedMatrix, 0, sizeof(publishedMatrix));
+    activeTables.store(0, std::memory_order_relaxed);
+    latencyStart.store(0, std::memory_order_relaxed);
+    keyChanged     = false;
+    menuRepeatTime = 0;
+    injectionsPending.store(0, std::memory_order_relaxed);
+    memset(injectMatrix, 0xff, sizeof(injectMatrix));
+    injectUntil = 0;
+    kbJoystickPortRequest.store(-1, std::memory_order_relaxed);
+    publishMatrix(true);
 
     // init div
     virtjoystickvalue = 0xff;
     detectreleasekey  = false;
 }
 
+// Blocks until input events arrive, wakes up at least every KB_IDLE_MS for the menu key repeat
 void KonsoolKB::handleKeyPress()
 {
     bsp_input_event_t event;
-    uint8_t           key_code;
-    static bool       keys_pressed[128];
-    static uint16_t   repeat_delay = 0;
-
-    // Reset C64 key matrix
-    sentdc00 = 0xff;
-    sentdc01 = 0xff;
 
     if (this->display == nullptr) {
         this->display = c64emu->cpu.vic->getDriver();
     }
-    // Sync menu state with menu draw routine
-    display->enableMenuOverlay(menuController->getVisible());
-
-    while (xQueueReceive(input_event_queue, &event, pdMS_TO_TICKS(1))) {
-        // use Keycodes to keep track of pressed keys
-        key_code = event.args_scancode.scancode;
-        switch (event.type) {
-            case INPUT_EVENT_TYPE_SCANCODE: {
-                keys_pressed[key_code & 0x7f] = (key_code & 0x80) ? false : true;
-                if (key_code == 0x40) {
-                    menuController->toggle();
-                }
-                if (key_code == 0x3f) {  // Switch between joystick port 1 & 2
-                    int cur_port = menuDataStore->getInt("kb_joystick_port", 1);
-                    menuDataStore->set("kb_joystick_port", cur_port == 1 ? 2 : 1);
-                    // TODO: Remove me later
-                    cur_port = menuDataStore->getInt("kb_joystick_port", 1);
-                    ESP_LOGI(TAG, "Switched to joystick port %d", cur_port);
-                }
-                break;
-            }
-            default:
-                break;
-        }
+
+    if (xQueueReceive(input_event_queue, &event, pdMS_TO_TICKS(KB_IDLE_MS))) {
+        TRACE_SCOPE(INPUT, "events");
+        eventTime = esp_timer_get_time();
+        do {
+            handleEvent(event);
+        } while (xQueueReceive(input_event_queue, &event, 0));
     }
 
-    // Handle C64 keyboard matrix based on pressed keys
-    if (menuController->getVisible()) {
-        if (repeat_delay < 2) {
-            repeat_delay++;
-            return;
-        }
-        if (keys_pressed[0x48]) {  // UP key code
-            ESP_LOGD(TAG, "Handling UP key press");
-            menuController->handleInput(MENU_OVERLAY_INPUT_TYPE_UP);
-            repeat_delay = 0;
-        } else if (keys_pressed[0x50]) {  // DOWN key code
-            ESP_LOGD(TAG, "Handling DOWN key press");
-            menuController->handleInput(MENU_OVERLAY_INPUT_TYPE_DOWN);
-            repeat_delay = 0;
-        } else if (keys_pressed[0x4b]) {  // LEFT key code
-            ESP_LOGD(TAG, "Handling LEFT key press");
-            menuController->handleInput(MENU_OVERLAY_INPUT_TYPE_LEFT);
-            repeat_delay = 0;
-        } else if (keys_pressed[0x4d]) {  // RIGHT key code
-            ESP_LOGD(TAG, "Handling RIGHT key press");
-            menuController->handleInput(MENU_OVERLAY_INPUT_TYPE_RIGHT);
-            repeat_delay = 0;
-        } else if (keys_pressed[0x01]) {  // ESC key code
-            ESP_LOGD(TAG, "Handling ESC key press");
-            menuController->handleInput(MENU_OVERLAY_INPUT_TYPE_LAST);
-            repeat_delay = 0;
-        } else if (keys_pressed[0x1c]) {  // ENTER key code
-            ESP_LOGD(TAG, "Handling ENTER key press");
-            menuController->handleInput(MENU_OVERLAY_INPUT_TYPE_SELECT);
-            repeat_delay = 0;
-        }
-    } else if (menuDataStore->getBool("kb_joystick_emu")) {
-        // TODO: Handle joystick input
-        virtjoystickvalue = 0xff;
-        // Allow UP, DOWN, LEFT, RIGHT, space for fire button
-        if (keys_pressed[0x48]) {  // UP key code
-            virtjoystickvalue = ~(1 << Joystick::C64JOYUP);
-        }
-        if (keys_pressed[0x50]) {  // DOWN key code
-            virtjoystickvalue &= ~(1 << Joystick::C64JOYDOWN);
-        }
-        if (keys_pressed[0x4b]) {  // LEFT key code
-            virtjoystickvalue &= ~(1 << Joystick::C64JOYLEFT);
-        }
-        if (keys_pressed[0x4d]) {  // RIGHT key code
-            virtjoystickvalue &= ~(1 << Joystick::C64JOYRIGHT);
-        }
-        if (keys_pressed[0x2a] || keys_pressed[0x1d]) {  // SHIFT key code
-            virtjoystickvalue &= ~(1 << Joystick::C64JOYFIRE);
-        }
-        // extra keys to make playing platform games easier
-        // Right shift is up + right
-        if (keys_pressed[0x36]) {  // RIGHT SHIFT key code
-            virtjoystickvalue &= ~(1 << Joystick::C64JOYUP);
-            virtjoystickvalue &= ~(1 << Joystick::C64JOYRIGHT);
-        }
-        // The '/' key is up + lift
-        if (keys_pressed[0x35]) {  // '/' key code
-            virtjoystickvalue &= ~(1 << Joystick::C64JOYUP);
-            virtjoystickvalue &= ~(1 << Joystick::C64JOYLEFT);
-        }
+    // the menu store is only changed by this task, its listeners update the CPU
+    int8_t port = kbJoystickPortRequest.exchange(-1, std::memory_order_relaxed);
+    if (port >= 0) {
+        kbJoystickPort.set(port);
     }
 
-    if (!menuController->getVisible() && virtjoystickvalue == 0xff) {
-        shiftctrlcode = 0;
+    // Sync menu state with menu draw routine
+    bool menuVisible = menuController->getVisible();
+    display->enableMenuOverlay(menuVisible);
+    if (menuVisible) {
+        handleMenuKeys();
+    }
+    updateVirtJoystick();
+    uint8_t taken = takeInjections();
+    publishMatrix(!menuVisible && (virtjoystickvalue == 0xff));
+    if (taken != 0) {
+        injectionsPending.fetch_sub(taken, std::memory_order_release);
+    }
+}
 
-        for (int i = 0; i < 128; i++) {
-            // shiftctrlcode = second byte bit 0 -> left shift, bit 1 -> ctrl, bit 2 -> commodore, bit 7 -> external
-            // command
-            if (i == 0x42 || i == 0x2a || i == 0x1d || i == 0x5d) {
-                continue;
+void KonsoolKB::handleEvent(const bsp_input_event_t& event)
+{
+    switch (event.type) {
+        case INPUT_EVENT_TYPE_SCANCODE: {
+            uint8_t key_code = event.args_scancode.scancode;
+            uint8_t key      = key_code & 0x7f;
+            bool    pressed  = !(key_code & 0x80);
+            if (keys_pressed[key] != pressed) {
+                keys_pressed[key] = pressed;
+                applyKey(key, pressed);
+                if (!keyChanged) {
+                    keyChanged    = true;
+                    keyChangeTime = eventTime;
+                }
             }
-            if (keys_pressed[i]) {
-                // Translate C64 keyboard matrix to KonsoleLED layout
-                // or it with the previous values
-                KbMatrixEntry ent = kb_matrix[i];
-                sentdc00          = sentdc00 & ent.sentdc00;
-                sentdc01          = sentdc01 & ent.sentdc01;
+            if (!pressed) {
+                break;
             }
+            // newly pressed menu keys are handled at once
+            menuRepeatTime = 0;
+            if (key_code == 0x40) {
+                MenuPriority menuPriority;
+                menuController->toggle();
+            }
+            if (key_code == 0x3f) {  // Switch between joystick port 1 & 2
+                kbJoystickPort.set(kbJoystickPort.get() == 1 ? 2 : 1);
+                ESP_LOGI(TAG, "Switched to joystick port %d", kbJoystickPort.get());
+            }
+            break;
         }
-        if (keys_pressed[0x42] || keys_pressed[0x2a]) {
-            shiftctrlcode = 1;
-        }
-        if (keys_pressed[0x1d]) {
-            shiftctrlcode |= 2;
-        }
-        if (keys_pressed[0x5d]) {
-            shiftctrlcode |= 4;
+        case INPUT_EVENT_TYPE_KEYBOARD: {
+            // text input for the menu, e.g. to search the file list
+            if (menuController->getVisible() && (event.args_keyboard.ascii != 0)) {
+                MenuPriority menuPriority;
+                menuController->handleChar(event.args_keyboard.ascii);
+            }
+            break;
         }
-    }
-
-    switch (event.type) {
         case INPUT_EVENT_TYPE_NAVIGATION: {
             konsoleled->set_led_color(4, 0xffff0000);
             konsoleled->show_led_colors();
@@ -203,7 +175,6 @@ void KonsoolKB::handleKeyPress()
             }
 
             switch (event.args_navigation.key) {
-                break;
                 case BSP_INPUT_NAVIGATION_KEY_VOLUME_DOWN:
                     if (audio_volume > 0) {
                         audio_volume -= 5;
@@ -229,77 +200,226 @@ void KonsoolKB::handleKeyPress()
         default:
             break;
     }
-    // Handle modifier keys
-    // if (event.args_keyboard.modifiers & BSP_INPUT_MODIFIER_SHIFT_L) {
-    //     shiftctrlcode = 1;
-    // }
-    if (event.args_keyboard.modifiers & BSP_INPUT_MODIFIER_CTRL) {
-        shiftctrlcode |= 2;
+}
+
+void KonsoolKB::handleMenuKeys()
+{
+    int64_t now = esp_timer_get_time();
+    if (now < menuRepeatTime) {
+        return;
     }
-    if (event.args_keyboard.modifiers & BSP_INPUT_NAVIGATION_KEY_SUPER) {
-        shiftctrlcode |= 4;
+    menu_overlay_input_type_t input;
+    if (keys_pressed[0x48]) {  // UP key code
+        ESP_LOGD(TAG, "Handling UP key press");
+        input = MENU_OVERLAY_INPUT_TYPE_UP;
+    } else if (keys_pressed[0x50]) {  // DOWN key code
+        ESP_LOGD(TAG, "Handling DOWN key press");
+        input = MENU_OVERLAY_INPUT_TYPE_DOWN;
+    } else if (keys_pressed[0x4b]) {  // LEFT key code
+        ESP_LOGD(TAG, "Handling LEFT key press");
+        input = MENU_OVERLAY_INPUT_TYPE_LEFT;
+    } else if (keys_pressed[0x4d]) {  // RIGHT key code
+        ESP_LOGD(TAG, "Handling RIGHT key press");
+        input = MENU_OVERLAY_INPUT_TYPE_RIGHT;
+    } else if (keys_pressed[0x01]) {  // ESC key code
+        ESP_LOGD(TAG, "Handling ESC key press");
+        input = MENU_OVERLAY_INPUT_TYPE_LAST;
+    } else if (keys_pressed[0x1c]) {  // ENTER key code
+        ESP_LOGD(TAG, "Handling ENTER key press");
+        input = MENU_OVERLAY_INPUT_TYPE_SELECT;
+    } else {
+        return;
+    }
+    {
+        MenuPriority menuPriority;
+        menuController->handleInput(input);
     }
+    menuRepeatTime = esp_timer_get_time() + KB_MENU_REPEAT_MS * 1000;
 }
 
-uint8_t KonsoolKB::getdc01(uint8_t querydc00, bool xchgports)
+void KonsoolKB::updateVirtJoystick()
 {
-    uint8_t kbcode1;
-    uint8_t kbcode2;
-    if (xchgports) {
-        kbcode1 = sentdc01;
-        kbcode2 = sentdc00;
-    } else {
-        kbcode1 = sentdc00;
-        kbcode2 = sentdc01;
+    virtjoystickvalue = 0xff;
+    if (menuController->getVisible() || !kbJoystickEmu.get()) {
+        return;
     }
-    if (querydc00 == 0) {
-        return kbcode2;
+    // Allow UP, DOWN, LEFT, RIGHT, space for fire button
+    if (keys_pressed[0x48]) {  // UP key code
+        virtjoystickvalue &= ~(1 << Joystick::C64JOYUP);
     }
+    if (keys_pressed[0x50]) {  // DOWN key code
+        virtjoystickvalue &= ~(1 << Joystick::C64JOYDOWN);
+    }
+    if (keys_pressed[0x4b]) {  // LEFT key code
+        virtjoystickvalue &= ~(1 << Joystick::C64JOYLEFT);
+    }
+    if (keys_pressed[0x4d]) {  // RIGHT key code
+        virtjoystickvalue &= ~(1 << Joystick::C64JOYRIGHT);
+    }
+    if (keys_pressed[0x2a] || keys_pressed[0x1d]) {  // SHIFT key code
+        virtjoystickvalue &= ~(1 << Joystick::C64JOYFIRE);
+    }
+    // extra keys to make playing platform games easier
+    // Right shift is up + right
+    if (keys_pressed[0x36]) {  // RIGHT SHIFT key code
+        virtjoystickvalue &= ~(1 << Joystick::C64JOYUP);
+        virtjoystickvalue &= ~(1 << Joystick::C64JOYRIGHT);
+    }
+    // The '/' key is up + lift
+    if (keys_pressed[0x35]) {  // '/' key code
+        virtjoystickvalue &= ~(1 << Joystick::C64JOYUP);
+        virtjoystickvalue &= ~(1 << Joystick::C64JOYLEFT);
+    }
+}
 
-    // special case "shift" + "commodore"
-    if ((shiftctrlcode & 5) == 5) {
-        if (querydc00 == kbcode1) {
-            return kbcode2;
-        } else {
-            return 0xff;
+// Press or release a key in the matrix. Several keys can share a matrix position (e.g. keys with implicit shift and
+// left shift), so each position counts its pressed keys.
+void KonsoolKB::applyKey(uint8_t key, bool pressed)
+{
+    // extra keys for left shift and commodore
+    if (key == 0x42) {
+        key = 0x2a;
+    } else if (key == 0x5d) {
+        key = 0x5b;
+    }
+    countMatrixKey(kb_matrix[key], pressed);
+    if (kb_matrix[key].implicit_shift) {
+        countMatrixKey(kb_matrix[0x2a], pressed);
+    }
+}
+
+void KonsoolKB::countMatrixKey(const KbMatrixEntry& entry, bool pressed)
+{
+    for (uint8_t col = 0; col < 8; col++) {
+        if (entry.sentdc00 & (1 << col)) {
+            continue;
+        }
+        for (uint8_t row = 0; row < 8; row++) {
+            if (entry.sentdc01 & (1 << row)) {
+                continue;
+            }
+            if (pressed) {
+                keyCnt[col][row]++;
+                matrix[col] &= ~(1 << row);
+            } else if (keyCnt[col][row] > 0) {
+                keyCnt[col][row]--;
+                if (keyCnt[col][row] == 0) {
+                    matrix[col] |= 1 << row;
+                }
+            }
         }
     }
-    // key combined with a "special key" (shift, ctrl, commodore)?
-    if ((~querydc00 & 2) && (shiftctrlcode & 1)) {  // *query* left shift key?
-        if (kbcode1 == 0xfd) {
-            // handle scan of key codes in the same "row"
-            return kbcode2 & 0x7f;
-        } else {
-            return 0x7f;
+}
+
+// Take the keys posted by setKbcodes, the last one replaces an injection still held. Returns the number taken.
+uint8_t KonsoolKB::takeInjections()
+{
+    KeyInjection injection;
+    uint8_t      taken = 0;
+    while (injections.pop(injection)) {
+        memset(injectMatrix, 0xff, sizeof(injectMatrix));
+        for (uint8_t col = 0; col < 8; col++) {
+            if (!(injection.sentdc00 & (1 << col))) {
+                injectMatrix[col] &= injection.sentdc01;
+            }
         }
-    } else if ((~querydc00 & 0x40) && (shiftctrlcode & 1)) {  // *query* right shift key?
-        if (kbcode1 == 0xbf) {
-            // handle scan of key codes in the same "row"
-            return kbcode2 & 0xef;
-        } else {
-            return 0xef;
+        injectUntil = esp_timer_get_time() + (int64_t)injection.holdMs * 1000;
+        taken++;
+    }
+    return taken;
+}
+
+void KonsoolKB::publishMatrix(bool enabled)
+{
+    uint8_t newmatrix[8];
+    if (enabled) {
+        memcpy(newmatrix, matrix, sizeof(newmatrix));
+    } else {
+        memset(newmatrix, 0xff, sizeof(newmatrix));
+    }
+    if (esp_timer_get_time() < injectUntil) {
+        // injected keys are pressed in addition to the keyboard
+        for (uint8_t col = 0; col < 8; col++) {
+            newmatrix[col] &= injectMatrix[col];
         }
-    } else if ((~querydc00 & 0x80) && (shiftctrlcode & 2)) {  // *query* ctrl key?
-        if (kbcode1 == 0x7f) {
-            // handle scan of key codes in the same "row"
-            return kbcode2 & 0xfb;
-        } else {
-            return 0xfb;
+    }
+    if (memcmp(newmatrix, publishedMatrix, sizeof(newmatrix)) != 0) {
+        publishTables(newmatrix);
+    }
+    // the latency of a change is measured when it is published, else it is gone (e.g. press and release)
+    keyChanged = false;
+}
+
+// Precompute the port values for every possible selection: a selected line (bit = 0) on one port pulls down the
+// lines on the other port that it is connected to by pressed keys. The tables are built in the buffer the CPU task
+// doesn't use and then switched.
+void KonsoolKB::publishTables(const uint8_t* newmatrix)
+{
+    KeyTables& tables = keyTables[activeTables.load(std::memory_order_relaxed) ^ 1];
+    uint8_t    colsmatrix[8];
+    memset(colsmatrix, 0xff, sizeof(colsmatrix));
+    for (uint8_t col = 0; col < 8; col++) {
+        for (uint8_t row = 0; row < 8; row++) {
+            if (!(newmatrix[col] & (1 << row))) {
+                colsmatrix[row] &= ~(1 << col);
+            }
         }
-    } else if ((~querydc00 & 0x80) && (shiftctrlcode & 4)) {  // *query* commodore key?
-        if (kbcode1 == 0x7f) {
-            // handle scan of key codes in the same "row"
-            return kbcode2 & 0xdf;
-        } else {
-            return 0xdf;
+    }
+    for (int sel = 0; sel < 256; sel++) {
+        uint8_t rows = 0xff;
+        uint8_t cols = 0xff;
+        for (uint8_t i = 0; i < 8; i++) {
+            if (!(sel & (1 << i))) {
+                rows &= newmatrix[i];
+                cols &= colsmatrix[i];
+            }
         }
+        tables.rowsForCols[sel] = rows;
+        tables.colsForRows[sel] = cols;
     }
-    // query "main" key press
-    if (querydc00 == kbcode1) {
-        return kbcode2;
-    } else {
-        return 0xff;
+    memcpy(publishedMatrix, newmatrix, sizeof(publishedMatrix));
+    activeTables.store(activeTables.load(std::memory_order_relaxed) ^ 1, std::memory_order_release);
+    if (keyChanged) {
+        latencyStart.store(keyChangeTime | 1, std::memory_order_release);
+    }
+}
+
+// Called by the CPU task, the measured latency is handed to the task taking the stats
+void KonsoolKB::recordLatency()
+{
+    uint32_t start = latencyStart.exchange(0, std::memory_order_acquire);
+    if (start != 0) {
+        latencies.push((uint32_t)esp_timer_get_time() - start);
+    }
+}
+
+bool KonsoolKB::takeLatencyStats(uint32_t& avgUs, uint32_t& maxUs)
+{
+    uint32_t latency;
+    uint32_t sum = 0;
+    uint32_t cnt = 0;
+    maxUs        = 0;
+    while (latencies.pop(latency)) {
+        sum += latency;
+        cnt++;
+        if (latency > maxUs) {
+            maxUs = latency;
+        }
+    }
+    if (cnt == 0) {
+        return false;
     }
+    avgUs = sum / cnt;
+    return true;
+}
+
+uint8_t KonsoolKB::getdc01(uint8_t querydc00, bool xchgports)
+{
+    if (latencyStart.load(std::memory_order_relaxed) != 0) {
+        recordLatency();
+    }
+    const KeyTables& tables = keyTables[activeTables.load(std::memory_order_acquire)];
+    return xchgports ? tables.colsForRows[querydc00] : tables.rowsForCols[querydc00];
 }
 
 uint8_t KonsoolKB::getKBJoyValue(bool port2)
@@ -307,8 +427,16 @@ uint8_t KonsoolKB::getKBJoyValue(bool port2)
     return virtjoystickvalue;
 }
 
-void KonsoolKB::setKbcodes(uint8_t sentdc01, uint8_t sentdc00)
+void KonsoolKB::setKbcodes(uint8_t sentdc01, uint8_t sentdc00, uint32_t holdMs)
 {
-    this->sentdc01 = sentdc01;
-    this->sentdc00 = sentdc00;
+    // the input task is the only one publishing the key tables, it picks the key up within KB_IDLE_MS
+    KeyInjection injection;
+    injection.sentdc01 = sentdc01;
+    injection.sentdc00 = sentdc00;
+    injection.holdMs   = holdMs;
+    injectionsPending.fetch_add(1, std::memory_order_relaxed);
+    if (!injections.push(injection)) {
+        injectionsPending.fetch_sub(1, std::memory_order_relaxed);
+        ESP_LOGW(TAG, "key injection dropped");
+    }
 }
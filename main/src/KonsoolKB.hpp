@@ -16,9 +16,11 @@
  For the complete text of the GNU General Public License see
  http://www.gnu.org/licenses/.
 */
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include "DisplayDriver.hpp"
+#include "Mailbox.hpp"
 #include "bsp/input.h"
 #include "freertos/idf_additions.h"
 #include "konsoolled.hpp"
@@ -27,6 +29,7 @@
 
 class C64Emu;
 class ExternalCmds;
+struct KbMatrixEntry;
 
 class KonsoolKB {
    private:
@@ -34,10 +37,54 @@ class KonsoolKB {
     KonsoleLED*     konsoleled;
     DisplayDriver*  display;
     MenuController* menuController;
-    MenuDataStore*  menuDataStore = MenuDataStore::getInstance();
+    MenuSetting<int>  kbJoystickPort{"kb_joystick_port", 1};
+    MenuSetting<bool> kbJoystickEmu{"kb_joystick_emu", false};
 
-    uint8_t sentdc01;
-    uint8_t sentdc00;
+    // wake up interval of the input task without events, and key repeat delay in the menu
+    static const uint32_t KB_IDLE_MS        = 40;
+    static const uint32_t KB_MENU_REPEAT_MS = 240;
+    // the task waits for input events above the display loop, menu actions run at its priority
+    static const UBaseType_t KB_MENU_PRIO = 1;
+
+    // port values for each possible selection on the other port
+    struct KeyTables {
+        uint8_t rowsForCols[256];
+        uint8_t colsForRows[256];
+    };
+    // key pressed on behalf of an external command for holdMs
+    struct KeyInjection {
+        uint8_t  sentdc01 = 0xff;
+        uint8_t  sentdc00 = 0xff;
+        uint32_t holdMs   = 0;
+    };
+
+    bool keys_pressed[128];
+    // C64 keyboard matrix: for each line of port A ($dc00) the lines of port B ($dc01) it is connected to (bit = 0)
+    uint8_t matrix[8];
+    // number of pressed keys on each matrix position
+    uint8_t keyCnt[8][8];
+    // matrix the CPU task currently sees, double buffered lookup tables
+    uint8_t              publishedMatrix[8];
+    KeyTables            keyTables[2];
+    std::atomic<uint8_t> activeTables;
+    int64_t              menuRepeatTime;
+
+    // injected keys, posted by the CPU task and merged into the matrix by the input task until injectUntil
+    Mailbox<KeyInjection, 4> injections;
+    std::atomic<uint8_t>     injectionsPending;
+    uint8_t                  injectMatrix[8];
+    int64_t                  injectUntil;
+
+    // port of the keyboard joystick requested by an external command, set in the store by the input task (-1 = none)
+    std::atomic<int8_t> kbJoystickPortRequest;
+
+    // key event to CIA read latency: receive time of the current events and of the oldest key change not yet
+    // published, time of the published change not yet read by the CPU task (| 1, 0 = none), measured latencies (us)
+    uint32_t              eventTime;
+    bool                  keyChanged;
+    uint32_t              keyChangeTime;
+    std::atomic<uint32_t> latencyStart;
+    Mailbox<uint32_t, 16> latencies;
 
     QueueHandle_t input_event_queue;
 
@@ -46,14 +93,21 @@ class KonsoolKB {
     bool    menu_overlay_active = false;
     uint8_t audio_volume        = 60;
 
+    class MenuPriority;
+
+    void    handleEvent(const bsp_input_event_t& event);
+    void    handleMenuKeys();
+    void    updateVirtJoystick();
+    void    applyKey(uint8_t key, bool pressed);
+    void    countMatrixKey(const KbMatrixEntry& entry, bool pressed);
+    uint8_t takeInjections();
+    void    publishMatrix(bool enabled);
+    void    publishTables(const uint8_t* newmatrix);
+    void    recordLatency();
+
    public:
     bool     deviceConnected;
     uint8_t* buffer;
-    // shiftctrlcode: bit 0 -> shift
-    //                bit 1 -> ctrl
-    //                bit 2 -> commodore
-    //                bit 7 -> external command (cmd, x, 128)
-    uint8_t  shiftctrlcode;
     uint8_t  keypresseddowncnt;
     uint8_t  virtjoystickvalue;
     bool     keypresseddown;
@@ -64,5 +118,16 @@ class KonsoolKB {
     void    handleKeyPress();
     uint8_t getdc01(uint8_t dc00, bool xchgports);
     uint8_t getKBJoyValue(bool port2);
-    void    setKbcodes(uint8_t sentdc01, uint8_t sentdc00);
+    bool    takeLatencyStats(uint32_t& avgUs, uint32_t& maxUs);
+    // set the port of the keyboard joystick (0 = off) through the menu store, may be called from any task
+    void    requestKbJoystickPort(int port)
+    {
+        kbJoystickPortRequest.store(port, std::memory_order_relaxed);
+    }
+    // press the key at sentdc00 / sentdc01 for holdMs, may be called from the CPU task only
+    void    setKbcodes(uint8_t sentdc01, uint8_t sentdc00, uint32_t holdMs);
+    bool    injectionPending() const
+    {
+        return injectionsPending.load(std::memory_order_acquire) != 0;
+    }
 };
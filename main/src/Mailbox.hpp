@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer queue with N - 1 usable slots. One task pushes, another task pops;
+// an entry belongs to the producer until push() publishes it and to the consumer until pop() releases it.
+template <typename T, uint8_t N>
+class Mailbox {
+   private:
+    T                    entries[N];
+    std::atomic<uint8_t> head{0};  // next slot to write, only changed by the producer
+    std::atomic<uint8_t> tail{0};  // next slot to read, only changed by the consumer
+
+   public:
+    // producer side, returns false if the mailbox is full
+    bool push(const T& entry)
+    {
+        uint8_t h    = head.load(std::memory_order_relaxed);
+        uint8_t next = (h + 1) % N;
+        if (next == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        entries[h] = entry;
+        head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns false if the mailbox is empty
+    bool pop(T& entry)
+    {
+        uint8_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        entry      = entries[t];
+        entries[t] = T();
+        tail.store((t + 1) % N, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire); }
+};
@@ -0,0 +1,196 @@
+#include "PcSampler.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Config.hpp"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char* TAG = "PcSampler";
+
+struct RomSymbol {
+    uint16_t    addr;
+    const char* name;
+};
+
+// Well known BASIC and KERNAL ROM routines, sorted by address
+static const RomSymbol romSymbols[] = {
+    {0xa474, "READY"},  {0xa480, "MAIN"},   {0xa533, "LINKPRG"}, {0xa560, "INLIN"},  {0xa579, "CRUNCH"},
+    {0xa613, "FNDLIN"}, {0xa642, "SCRTCH"}, {0xa65e, "CLEAR"},   {0xa68e, "RUNC"},   {0xa69c, "LIST"},
+    {0xa742, "FOR"},    {0xa7ae, "NEWSTT"}, {0xa7e4, "GONE"},    {0xa82c, "ISCNTC"}, {0xa831, "END"},
+    {0xa871, "RUN"},    {0xa883, "GOSUB"},  {0xa8a0, "GOTO"},    {0xa8d2, "RETURN"}, {0xa8f8, "DATA"},
+    {0xa928, "IF"},     {0xa93b, "REM"},    {0xa96b, "LINGET"},  {0xa9a5, "LET"},    {0xaaa0, "PRINT"},
+    {0xab1e, "STROUT"}, {0xad9e, "FRMEVL"}, {0xae83, "EVAL"},    {0xb08b, "PTRGET"}, {0xb391, "GIVAYF"},
+    {0xb526, "GARBAG"}, {0xb850, "FSUB"},   {0xb867, "FADD"},    {0xba28, "FMULT"},  {0xbb0f, "FDIV"},
+    {0xbba2, "MOVFM"},  {0xbc0c, "MOVAF"},  {0xbc5b, "FCOMP"},   {0xbcf3, "FIN"},    {0xbdcd, "LINPRT"},
+    {0xbddd, "FOUT"},   {0xbf71, "SQR"},    {0xbfed, "EXP"},     {0xe097, "RND"},    {0xe264, "COS"},
+    {0xe26b, "SIN"},    {0xe2b4, "TAN"},    {0xe30e, "ATN"},     {0xe544, "CLSR"},   {0xe566, "HOME"},
+    {0xe56c, "PLOT"},   {0xe5b4, "LP2"},    {0xe716, "PRT"},     {0xe8ea, "SCROL"},  {0xe9ff, "CLRLN"},
+    {0xea31, "IRQ"},    {0xea81, "IRQEND"}, {0xea87, "SCNKEY"},  {0xed09, "TALK"},   {0xed0c, "LISTEN"},
+    {0xee13, "ACPTR"},  {0xf13e, "GETIN"},  {0xf157, "CHRIN"},   {0xf1ca, "CHROUT"}, {0xf49e, "LOAD"},
+    {0xf5dd, "SAVE"},   {0xf69b, "UDTIM"},  {0xf6ed, "STOP"},    {0xfce2, "RESET"},  {0xfd15, "RESTOR"},
+    {0xfd50, "RAMTAS"}, {0xfda3, "IOINIT"}, {0xfe43, "NMI"},     {0xff48, "PULS"},   {0xff5b, "CINT"},
+    {0xff81, "JUMPTABLE"},
+};
+static const size_t NUMROMSYMBOLS = sizeof(romSymbols) / sizeof(romSymbols[0]);
+
+// labels further away from a symbol are not trusted
+static const uint16_t MAXSYMBOLOFFSET = 0x100;
+
+// Index of the ROM symbol addr belongs to, NUMROMSYMBOLS if there is none
+static size_t findSymbol(uint16_t addr)
+{
+    size_t found = NUMROMSYMBOLS;
+    for (size_t i = 0; (i < NUMROMSYMBOLS) && (romSymbols[i].addr <= addr); i++) {
+        found = i;
+    }
+    if ((found < NUMROMSYMBOLS) && (addr - romSymbols[found].addr >= MAXSYMBOLOFFSET)) {
+        found = NUMROMSYMBOLS;
+    }
+    return found;
+}
+
+// Insert value into the descending top list of count entries
+static void insertTop(uint32_t* topValues, uint32_t* topKeys, size_t count, uint32_t value, uint32_t key)
+{
+    if ((value == 0) || (value <= topValues[count - 1])) {
+        return;
+    }
+    size_t i = count - 1;
+    for (; (i > 0) && (topValues[i - 1] < value); i--) {
+        topValues[i] = topValues[i - 1];
+        topKeys[i]   = topKeys[i - 1];
+    }
+    topValues[i] = value;
+    topKeys[i]   = key;
+}
+
+PcSampler::~PcSampler()
+{
+    heap_caps_free(buckets);
+}
+
+void PcSampler::add(uint16_t pc, bool basicRom, bool kernalRom)
+{
+    uint32_t bucket = pc;
+    if (basicRom && (pc >= 0xa000) && (pc <= 0xbfff)) {
+        bucket = BASICBUCKETS + (pc - 0xa000);
+    } else if (kernalRom && (pc >= 0xe000)) {
+        bucket = KERNALBUCKETS + (pc - 0xe000);
+    }
+    buckets[bucket]++;
+    numSamples++;
+}
+
+bool PcSampler::poll(uint64_t cycle)
+{
+    uint32_t newInterval = startRequest.exchange(0);
+    if (newInterval != 0) {
+        if (buckets == nullptr) {
+            // allocated on first use and kept
+            buckets = (uint32_t*)heap_caps_malloc(NUMBUCKETS * sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+        }
+        if (buckets != nullptr) {
+            memset(buckets, 0, NUMBUCKETS * sizeof(uint32_t));
+            numSamples = 0;
+            interval   = newInterval;
+            nextSample = cycle + interval;
+            running    = true;
+            ESP_LOGI(TAG, "sampling every %d cycles", (int)interval);
+        } else {
+            ESP_LOGE(TAG, "no memory for the PC histogram");
+        }
+    }
+    if (reportRequest.exchange(false) && running) {
+        running = false;
+        report();
+    }
+    return running;
+}
+
+void PcSampler::report()
+{
+    const size_t count = Config::PCSAMPLERTOPN;
+    uint32_t     topValues[count];
+    uint32_t     topKeys[count];
+    char         label[32];
+
+    // share in tenths of a percent
+    auto percent   = [this](uint32_t n) { return (int)((uint64_t)n * 1000 / (numSamples ? numSamples : 1)); };
+    auto addrLabel = [&](uint32_t bucket) {
+        uint16_t    addr = bucket;
+        const char* rom  = "";
+        if (bucket >= KERNALBUCKETS) {
+            addr = 0xe000 + (bucket - KERNALBUCKETS);
+            rom  = "KERNAL ";
+        } else if (bucket >= BASICBUCKETS) {
+            addr = 0xa000 + (bucket - BASICBUCKETS);
+            rom  = "BASIC ";
+        }
+        size_t sym = (*rom != '\0') ? findSymbol(addr) : NUMROMSYMBOLS;
+        if (sym < NUMROMSYMBOLS) {
+            snprintf(label, sizeof(label), "$%04x %s%s+%d", addr, rom, romSymbols[sym].name,
+                     addr - romSymbols[sym].addr);
+        } else {
+            snprintf(label, sizeof(label), "$%04x %s", addr, rom);
+        }
+    };
+
+    ESP_LOGI(TAG, "%d samples, every %d cycles", (int)numSamples, (int)interval);
+
+    // hottest addresses
+    memset(topValues, 0, sizeof(topValues));
+    for (uint32_t b = 0; b < NUMBUCKETS; b++) {
+        insertTop(topValues, topKeys, count, buckets[b], b);
+    }
+    ESP_LOGI(TAG, "hot addresses:");
+    for (size_t i = 0; (i < count) && (topValues[i] != 0); i++) {
+        addrLabel(topKeys[i]);
+        ESP_LOGI(TAG, "%3d.%d%% %8d  %s", percent(topValues[i]) / 10, percent(topValues[i]) % 10, (int)topValues[i],
+                 label);
+    }
+
+    // hottest routines: ROM code by symbol, everything else by page
+    // keys: 0x000-0x0ff RAM pages, 0x100-0x13f ROM pages without symbol, 0x200 + symbol index
+    static const uint32_t ROMPAGEKEYS = 0x100;
+    static const uint32_t SYMBOLKEYS  = 0x200;
+    uint32_t*             groups = (uint32_t*)calloc(SYMBOLKEYS + NUMROMSYMBOLS, sizeof(uint32_t));
+    if (groups == nullptr) {
+        return;
+    }
+    for (uint32_t b = 0; b < NUMBUCKETS; b++) {
+        if (buckets[b] == 0) continue;
+        if (b < BASICBUCKETS) {
+            groups[b >> 8] += buckets[b];
+            continue;
+        }
+        uint16_t addr = (b >= KERNALBUCKETS) ? 0xe000 + (b - KERNALBUCKETS) : 0xa000 + (b - BASICBUCKETS);
+        size_t   sym  = findSymbol(addr);
+        if (sym < NUMROMSYMBOLS) {
+            groups[SYMBOLKEYS + sym] += buckets[b];
+        } else {
+            groups[ROMPAGEKEYS + ((b - BASICBUCKETS) >> 8)] += buckets[b];
+        }
+    }
+    memset(topValues, 0, sizeof(topValues));
+    for (uint32_t k = 0; k < SYMBOLKEYS + NUMROMSYMBOLS; k++) {
+        insertTop(topValues, topKeys, count, groups[k], k);
+    }
+    free(groups);
+    ESP_LOGI(TAG, "hot routines:");
+    for (size_t i = 0; (i < count) && (topValues[i] != 0); i++) {
+        uint32_t k = topKeys[i];
+        if (k >= SYMBOLKEYS) {
+            const RomSymbol& sym = romSymbols[k - SYMBOLKEYS];
+            snprintf(label, sizeof(label), "%s %s", (sym.addr >= 0xe000) ? "KERNAL" : "BASIC", sym.name);
+        } else if (k >= ROMPAGEKEYS) {
+            uint32_t page = k - ROMPAGEKEYS;
+            snprintf(label, sizeof(label), "%s page $%02x", (page >= 0x20) ? "KERNAL" : "BASIC",
+                     (page >= 0x20) ? 0xe0 + page - 0x20 : 0xa0 + page);
+        } else {
+            snprintf(label, sizeof(label), "RAM page $%02x", (int)k);
+        }
+        ESP_LOGI(TAG, "%3d.%d%% %8d  %s", percent(topValues[i]) / 10, percent(topValues[i]) % 10, (int)topValues[i],
+                 label);
+    }
+}
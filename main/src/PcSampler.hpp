@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Sampling profiler for guest programs: the 6502 PC is sampled every interval emulated cycles into a histogram in
+// PSRAM with one bucket per address, separate for code running in RAM and in the BASIC / KERNAL ROMs. The report lists
+// the hottest addresses and routines (ROM routines by name, RAM code by page). Start and report are requested from
+// any task and carried out by the CPU task.
+class PcSampler {
+   private:
+    static const uint32_t BASICBUCKETS  = 0x10000;  // BASIC ROM $a000-$bfff
+    static const uint32_t KERNALBUCKETS = 0x12000;  // KERNAL ROM $e000-$ffff
+    static const uint32_t NUMBUCKETS    = 0x14000;
+
+    uint32_t* buckets    = nullptr;
+    uint32_t  numSamples = 0;
+    uint32_t  interval   = 0;
+    uint64_t  nextSample = 0;
+    bool      running    = false;
+
+    std::atomic<uint32_t> startRequest{0};  // interval of a requested start
+    std::atomic<bool>     reportRequest{false};
+
+    void report();
+
+   public:
+    PcSampler() = default;
+    ~PcSampler();
+    PcSampler(const PcSampler&)            = delete;
+    PcSampler& operator=(const PcSampler&) = delete;
+
+    // Start over sampling every interval cycles resp. stop and log the report, may be called from any task
+    void requestStart(uint32_t interval)
+    {
+        startRequest = interval;
+    }
+    void requestReport()
+    {
+        reportRequest = true;
+    }
+
+    // Carry out requests, called by the CPU task between frames. Returns true while sampling.
+    bool poll(uint64_t cycle);
+
+    // Called by the CPU task for every instruction while sampling, basicRom / kernalRom tell if the ROMs are banked in
+    inline void check(uint64_t cycle, uint16_t pc, bool basicRom, bool kernalRom) __attribute__((always_inline))
+    {
+        if (cycle >= nextSample) {
+            nextSample += interval;
+            add(pc, basicRom, kernalRom);
+        }
+    }
+    void add(uint16_t pc, bool basicRom, bool kernalRom);
+};
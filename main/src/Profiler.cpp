@@ -0,0 +1,73 @@
+#include "Profiler.hpp"
+
+#if defined(USE_PROFILER)
+#include <cstdio>
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char* TAG = "Profiler";
+
+static const char* sectionNames[Profiler::NUMSECTIONS] = {"cpu", "cia", "vic", "sid", "i2s", "ppa", "dsi"};
+
+// duration of a PAL frame in us
+static const uint32_t FRAME_BUDGET_US = 19950;
+
+Profiler::CoreState   Profiler::cores[SOC_CPU_CORES_NUM];
+uint32_t              Profiler::frameCycles[Profiler::NUMSECTIONS];
+Profiler::Stats       Profiler::stats[Profiler::NUMSECTIONS];
+char                  Profiler::hudText[2][Profiler::HUDTEXTSIZE];
+std::atomic<uint32_t> Profiler::hudGeneration{0};
+std::atomic<bool>     Profiler::hudEnabled{false};
+
+void Profiler::endFrame(Section first, Section last)
+{
+    for (uint8_t s = first; s <= last; s++) {
+        uint32_t cycles = frameCycles[s];
+        frameCycles[s]  = 0;
+        if (cycles < stats[s].minCycles.load(std::memory_order_relaxed)) {
+            stats[s].minCycles.store(cycles, std::memory_order_relaxed);
+        }
+        if (cycles > stats[s].maxCycles.load(std::memory_order_relaxed)) {
+            stats[s].maxCycles.store(cycles, std::memory_order_relaxed);
+        }
+        stats[s].sumCycles.fetch_add(cycles, std::memory_order_relaxed);
+        stats[s].frames.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Profiler::report(uint32_t fps, bool log)
+{
+    const uint32_t cyclesPerUs = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+
+    char*  text = hudText[(hudGeneration.load() + 1) & 1];
+    size_t size = sizeof(hudText[0]);
+    int    len  = snprintf(text, size, "fps %d, us per frame\n      min   avg   max\n", (int)fps);
+    for (uint8_t s = 0; s < NUMSECTIONS; s++) {
+        uint32_t frames = stats[s].frames.exchange(0, std::memory_order_relaxed);
+        uint32_t sum    = stats[s].sumCycles.exchange(0, std::memory_order_relaxed);
+        uint32_t min    = stats[s].minCycles.exchange(UINT32_MAX, std::memory_order_relaxed);
+        uint32_t max    = stats[s].maxCycles.exchange(0, std::memory_order_relaxed);
+        if (frames == 0) {
+            min = 0;
+        }
+        uint32_t minUs = min / cyclesPerUs;
+        uint32_t avgUs = frames ? sum / frames / cyclesPerUs : 0;
+        uint32_t maxUs = max / cyclesPerUs;
+        if ((len >= 0) && ((size_t)len < size)) {
+            len += snprintf(text + len, size - len, "%s %5d %5d %5d\n", sectionNames[s], (int)minUs, (int)avgUs,
+                            (int)maxUs);
+        }
+        if (log && (frames != 0)) {
+            ESP_LOGI(TAG, "%s: min %d us, avg %d us, max %d us (%d%% of frame)", sectionNames[s], (int)minUs,
+                     (int)avgUs, (int)maxUs, (int)(avgUs * 100 / FRAME_BUDGET_US));
+        }
+    }
+    hudGeneration.fetch_add(1);
+}
+
+const char* Profiler::getHudText(uint32_t& generation)
+{
+    generation = hudGeneration.load();
+    return hudText[generation & 1];
+}
+#endif
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Config.hpp"
+
+#if defined(USE_PROFILER)
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "esp_cpu.h"
+#include "soc/soc_caps.h"
+
+// Cycle cost profiler of the emulator subsystems. Code sections are measured with the CPU cycle counter, nested
+// sections are exclusive: the time spent in an inner section (e.g. SID inside VIC) is only charged to the inner one.
+// The cycles are summed per frame and reported per second as min/avg/max per frame, in the log and on the HUD.
+// Each section must only be measured by one task and the tasks must be pinned to a core.
+class Profiler {
+   public:
+    enum Section : uint8_t { CPU, CIA, VIC, SID, I2S, PPA, DSI, NUMSECTIONS, NONE = NUMSECTIONS };
+
+   private:
+    struct CoreState {
+        Section  current = NONE;  // innermost active section on this core
+        uint32_t since   = 0;     // cycle count when current was entered or resumed
+    };
+    struct Stats {
+        std::atomic<uint32_t> minCycles{UINT32_MAX};
+        std::atomic<uint32_t> maxCycles{0};
+        std::atomic<uint32_t> sumCycles{0};
+        std::atomic<uint32_t> frames{0};
+    };
+
+    static const size_t HUDTEXTSIZE = 320;
+
+    static CoreState             cores[SOC_CPU_CORES_NUM];
+    static uint32_t              frameCycles[NUMSECTIONS];
+    static Stats                 stats[NUMSECTIONS];
+    static char                  hudText[2][HUDTEXTSIZE];
+    static std::atomic<uint32_t> hudGeneration;
+
+   public:
+    static std::atomic<bool> hudEnabled;
+
+    // Measures a section for the lifetime of the object
+    class Scope {
+       private:
+        CoreState& core;
+        Section    outer;
+
+       public:
+        inline Scope(Section section) __attribute__((always_inline)) : core(cores[esp_cpu_get_core_id()])
+        {
+            uint32_t now = esp_cpu_get_cycle_count();
+            if (core.current != NONE) {
+                frameCycles[core.current] += now - core.since;
+            }
+            outer        = core.current;
+            core.current = section;
+            core.since   = now;
+        }
+        inline ~Scope() __attribute__((always_inline))
+        {
+            uint32_t now = esp_cpu_get_cycle_count();
+            frameCycles[core.current] += now - core.since;
+            core.current = outer;
+            core.since   = now;
+        }
+    };
+
+    // Add the cycles of the sections first..last to the frame statistics, called by the measuring task once per frame
+    static void endFrame(Section first, Section last);
+
+    // Per second report, called by the profiling timer
+    static void report(uint32_t fps, bool log);
+
+    // HUD text of the last report, generation changes with every report
+    static const char* getHudText(uint32_t& generation);
+};
+
+#define PROFILE_SCOPE(section)         Profiler::Scope profileScope(Profiler::section)
+#define PROFILE_END_FRAME(first, last) Profiler::endFrame(Profiler::first, Profiler::last)
+#else
+#define PROFILE_SCOPE(section)
+#define PROFILE_END_FRAME(first, last)
+#endif
@@ -0,0 +1,100 @@
+#include "RasterTracer.hpp"
+
+#if defined(USE_RASTERTRACER)
+#include <cstdio>
+#include <cstring>
+#include "sdkconfig.h"
+
+// time of a real PAL raster line in us
+static const uint32_t LINE_BUDGET_US = 64;
+
+uint32_t            RasterTracer::lineStart  = 0;
+uint32_t            RasterTracer::frameCount = 0;
+uint32_t            RasterTracer::current[LINES_PER_FRAME];
+RasterTracer::Frame RasterTracer::worst[RasterTracer::NUMWORSTFRAMES];
+uint8_t             RasterTracer::numWorst = 0;
+std::atomic<bool>   RasterTracer::dumpRequested{false};
+
+// Keep the current frame in a free slot or instead of the best of the kept frames if it is worse
+void RasterTracer::keepFrame(uint32_t total)
+{
+    uint8_t slot = numWorst;
+    if (numWorst == NUMWORSTFRAMES) {
+        slot = 0;
+        for (uint8_t i = 1; i < NUMWORSTFRAMES; i++) {
+            if (worst[i].total < worst[slot].total) slot = i;
+        }
+        if (total <= worst[slot].total) slot = NUMWORSTFRAMES;
+    } else {
+        numWorst++;
+    }
+    if (slot < NUMWORSTFRAMES) {
+        worst[slot].frame = frameCount;
+        worst[slot].total = total;
+        memcpy(worst[slot].lines, current, sizeof(current));
+    }
+}
+
+void RasterTracer::frameDone()
+{
+    uint32_t total = 0;
+    for (uint16_t i = 0; i < LINES_PER_FRAME; i++) {
+        total += current[i];
+    }
+    // the first frame has no valid start time
+    if (++frameCount > 1) {
+        keepFrame(total);
+    }
+
+    if (dumpRequested.exchange(false)) {
+        dump();
+        numWorst = 0;
+    }
+}
+
+// One column per kept frame in the order they occurred, one row per raster line, all times in us. The rows before
+// the lines hold the frame number, the frame time and the number of lines over budget.
+void RasterTracer::dump()
+{
+    const uint32_t cyclesPerUs = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+
+    uint8_t order[NUMWORSTFRAMES];
+    for (uint8_t i = 0; i < numWorst; i++) {
+        order[i] = i;
+    }
+    for (uint8_t i = 1; i < numWorst; i++) {
+        for (uint8_t j = i; (j > 0) && (worst[order[j]].frame < worst[order[j - 1]].frame); j--) {
+            uint8_t tmp  = order[j];
+            order[j]     = order[j - 1];
+            order[j - 1] = tmp;
+        }
+    }
+
+    printf("# raster trace: %d worst of %d frames\n", numWorst, (int)frameCount);
+    printf("frame");
+    for (uint8_t i = 0; i < numWorst; i++) {
+        printf(",%d", (int)worst[order[i]].frame);
+    }
+    printf("\ntotal");
+    for (uint8_t i = 0; i < numWorst; i++) {
+        printf(",%d", (int)(worst[order[i]].total / cyclesPerUs));
+    }
+    printf("\noverruns");
+    for (uint8_t i = 0; i < numWorst; i++) {
+        uint16_t overruns = 0;
+        for (uint16_t line = 0; line < LINES_PER_FRAME; line++) {
+            if (worst[order[i]].lines[line] > LINE_BUDGET_US * cyclesPerUs) overruns++;
+        }
+        printf(",%d", overruns);
+    }
+    printf("\n");
+    for (uint16_t line = 0; line < LINES_PER_FRAME; line++) {
+        printf("%d", line);
+        for (uint8_t i = 0; i < numWorst; i++) {
+            printf(",%d", (int)(worst[order[i]].lines[line] / cyclesPerUs));
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+#endif
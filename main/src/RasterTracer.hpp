@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Config.hpp"
+
+#if defined(USE_RASTERTRACER)
+#include <atomic>
+#include <cstdint>
+#include "esp_cpu.h"
+
+// Host time spent per raster line, to find the lines that make CPUC64::run fall behind the 64 us a real raster line
+// takes. The times of the current frame are collected with the CPU cycle counter, the worst frames (by total time)
+// are kept with all their lines and can be dumped as CSV to the console. Must only be fed by the CPU task.
+class RasterTracer {
+   public:
+    static const uint8_t NUMWORSTFRAMES = 8;
+
+   private:
+    struct Frame {
+        uint32_t frame;
+        uint32_t total;
+        uint32_t lines[LINES_PER_FRAME];
+    };
+
+    static uint32_t          lineStart;
+    static uint32_t          frameCount;
+    static uint32_t          current[LINES_PER_FRAME];
+    static Frame             worst[NUMWORSTFRAMES];
+    static uint8_t           numWorst;
+    static std::atomic<bool> dumpRequested;
+
+    static void keepFrame(uint32_t total);
+    static void dump();
+
+   public:
+    // End of a raster line: its time is the time since the end of the previous line
+    static inline void lineDone(uint16_t rasterline) __attribute__((always_inline))
+    {
+        uint32_t now        = esp_cpu_get_cycle_count();
+        current[rasterline] = now - lineStart;
+        lineStart           = now;
+    }
+    // Continue after a pause that does not belong to a raster line, e.g. waiting for the next frame
+    static inline void resume() __attribute__((always_inline))
+    {
+        lineStart = esp_cpu_get_cycle_count();
+    }
+
+    // End of a frame: keep it if it is one of the worst, dump if requested
+    static void frameDone();
+
+    // Dump the worst frames at the end of the current frame and start over, can be called from any task
+    static void requestDump()
+    {
+        dumpRequested = true;
+    }
+};
+
+#define RASTERTRACE_LINE(rasterline) RasterTracer::lineDone(rasterline)
+#define RASTERTRACE_FRAME()          RasterTracer::frameDone()
+#define RASTERTRACE_RESUME()         RasterTracer::resume()
+#else
+#define RASTERTRACE_LINE(rasterline)
+#define RASTERTRACE_FRAME()
+#define RASTERTRACE_RESUME()
+#endif
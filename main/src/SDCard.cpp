@@ -1,6 +1,7 @@
 #include "SDCard.hpp"
 #include <dirent.h>
 #include <fcntl.h>
+#include <strings.h>
 #include <sys/stat.h>
 #include <sys/unistd.h>
 #include <cstdint>
@@ -8,14 +9,18 @@
 #include <string>
 #include <vector>
 #include "Config.hpp"
+#include "EventTrace.hpp"
 // #include "driver/sdmmc_default_configs.h"
 #include "driver/sdmmc_host.h"
 #include "driver/sdspi_host.h"
 // #include "driver/spi_common.h"
 #include "esp_err.h"
+#include "esp_heap_caps.h"
 // #include "esp_intr_types.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_vfs_fat.h"
+#include "freertos/idf_additions.h"
 #include "hal/ldo_types.h"
 // #include "hal/spi_types.h"
 #include "sd_protocol_types.h"
@@ -27,52 +32,128 @@
 
 static const char* TAG = "SDCard";
 
-SDCard::SDCard() : initialized(false) {
+// poll interval of the mount task: retry mounting resp. check if a mounted card was removed
+static const uint32_t SDCARD_RETRY_MS = 2000;
+static const uint32_t SDCARD_CHECK_MS = 1000;
+// number of saves that can be pending
+static const uint8_t SDCARD_SAVE_JOBS = 4;
+
+SDCard::SDCard() : fileCache(Config::FILECACHESIZE, Config::FILECACHEMAXFILESIZE) {
 }
 
 SDCard::~SDCard() {
-    if (initialized) {
-        sdspi_host_deinit();
+    if (state == State::READY) {
+        unmount();
     }
 }
 
-bool SDCard::init() {
-    esp_err_t ret;
-    if (initialized) {
-        return true;
-    }
+void SDCard::start() {
+#if defined(USE_SDCARD)
+    saveQueue = xQueueCreate(SDCARD_SAVE_JOBS, sizeof(SaveJob*));
+    doneQueue = xQueueCreate(SDCARD_SAVE_JOBS, sizeof(SaveJob*));
+    xTaskCreatePinnedToCore(mountTaskWrapper,  // Function to implement the task
+                            "sdcard",          // Name of the task
+                            4096,              // Stack size in words
+                            this,              // Task input parameter
+                            1,                 // Priority of the task
+                            NULL,              // Task handle
+                            0);                // Core where the task should run
+#endif
+}
 
+SDCard::FsUse::FsUse(SDCard& sdcard) : sdcard(sdcard) {
+    // counted before the state is checked, so the mount task either sees this user or the user sees the card gone
+    sdcard.fsUsers++;
+    ready = sdcard.isReady();
+    if (!ready) {
+        sdcard.fsUsers--;
+    }
+}
 
-#if defined(USE_SDCARD)
+SDCard::FsUse::~FsUse() {
+    if (ready) {
+        sdcard.fsUsers--;
+    }
+}
 
-    // ESP_LOGI(TAG, "Initialize SDCard power");
+void SDCard::mountTaskWrapper(void* param) {
+    static_cast<SDCard*>(param)->mountTask();
+}
 
-    sd_pwr_ctrl_ldo_config_t ldo_config = {
-        .ldo_chan_id = LDO_UNIT_4,  // SDCard powered by VO4
-    };
-    sd_pwr_ctrl_handle_t pwr_ctrl_handle = NULL;
+// Mount state machine: absent / error -> mounting -> ready -> absent when the card is removed.
+// Between the state checks the task writes posted saves.
+void SDCard::mountTask() {
+    while (true) {
+        SaveJob* job;
+        uint32_t delay = (state == State::READY) ? SDCARD_CHECK_MS : SDCARD_RETRY_MS;
+        if (xQueueReceive(saveQueue, &job, delay / portTICK_PERIOD_MS) == pdTRUE) {
+            TRACE_BEGIN(SDCARD, "save");
+            job->ok = isReady() && writeSave(*job);
+            TRACE_END(SDCARD, "save");
+            heap_caps_free(job->data);
+            job->data = nullptr;
+            xQueueSend(doneQueue, &job, portMAX_DELAY);
+            continue;
+        }
 
-    ret = sd_pwr_ctrl_new_on_chip_ldo(&ldo_config, &pwr_ctrl_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create a new on-chip LDO power control driver");
-        return false;
+        State current = state.load();
+        if (current == State::READY) {
+            // a removed card no longer answers status requests
+            if (sdmmc_get_status(mount_card) != ESP_OK) {
+                ESP_LOGI(TAG, "SD card removed");
+                removed();
+            }
+        } else {
+            state         = State::MOUNTING;
+            TRACE_BEGIN(SDCARD, "mount");
+            esp_err_t ret = mount();
+            TRACE_END(SDCARD, "mount");
+            if (ret == ESP_OK) {
+                mountCount++;
+                state = State::READY;
+            } else {
+                // a missing card does not answer at all, any other failure is an error
+                State next = ((ret == ESP_ERR_TIMEOUT) || (ret == ESP_ERR_NOT_FOUND)) ? State::ABSENT : State::ERROR;
+                if (next != current) {
+                    ESP_LOGE(TAG, "Failed to mount SD card: %s", esp_err_to_name(ret));
+                }
+                state = next;
+            }
+        }
     }
-    host.pwr_ctrl_handle = pwr_ctrl_handle;
+}
 
-    vTaskDelay(500 / portTICK_PERIOD_MS);
+esp_err_t SDCard::mount() {
+    esp_err_t ret;
+
+    if (host.pwr_ctrl_handle == NULL) {
+        // ESP_LOGI(TAG, "Initialize SDCard power");
+        sd_pwr_ctrl_ldo_config_t ldo_config = {
+            .ldo_chan_id = LDO_UNIT_4,  // SDCard powered by VO4
+        };
+        sd_pwr_ctrl_handle_t pwr_ctrl_handle = NULL;
+
+        ret = sd_pwr_ctrl_new_on_chip_ldo(&ldo_config, &pwr_ctrl_handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create a new on-chip LDO power control driver");
+            return ret;
+        }
+        host.pwr_ctrl_handle = pwr_ctrl_handle;
 
-    ESP_LOGI(TAG, "Setup sdio slot");
+        vTaskDelay(500 / portTICK_PERIOD_MS);
 
-    slot_config.clk    = static_cast<gpio_num_t>(BSP_SDCARD_CLK);
-    slot_config.cmd    = static_cast<gpio_num_t>(BSP_SDCARD_CMD);
-    slot_config.d0     = static_cast<gpio_num_t>(BSP_SDCARD_D0);
-    slot_config.d1     = static_cast<gpio_num_t>(BSP_SDCARD_D1);
-    slot_config.d2     = static_cast<gpio_num_t>(BSP_SDCARD_D2);
-    slot_config.d3     = static_cast<gpio_num_t>(BSP_SDCARD_D3);
-    slot_config.width  = 4;
-    slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+        ESP_LOGI(TAG, "Setup sdio slot");
+
+        slot_config.clk    = static_cast<gpio_num_t>(BSP_SDCARD_CLK);
+        slot_config.cmd    = static_cast<gpio_num_t>(BSP_SDCARD_CMD);
+        slot_config.d0     = static_cast<gpio_num_t>(BSP_SDCARD_D0);
+        slot_config.d1     = static_cast<gpio_num_t>(BSP_SDCARD_D1);
+        slot_config.d2     = static_cast<gpio_num_t>(BSP_SDCARD_D2);
+        slot_config.d3     = static_cast<gpio_num_t>(BSP_SDCARD_D3);
+        slot_config.width  = 4;
+        slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+    }
 
-    ESP_LOGI(TAG, "Mounting SDcard");
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
         .format_if_mount_failed   = false,
         .max_files                = 5,
@@ -85,43 +166,59 @@ bool SDCard::init() {
 
     ret = esp_vfs_fat_sdmmc_mount(mount_point, &host, &slot_config, &mount_config, &mount_card);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to mount SD card: %s", esp_err_to_name(ret));
-        return false;
+        return ret;
     }
 
     // Get some info about the card
     sdmmc_card_print_info(stdout, mount_card);
 
-    ESP_LOGI(TAG, "SDcard initialized");
+    ESP_LOGI(TAG, "SDcard mounted");
 
     // Make sure the C64PRG directory exists if it doesn't already exist
     ESP_LOGI(TAG, "Checking if PRG directory exists");
     struct stat st;
     if (stat(SD_CARD_PRG_PATH, &st) != 0) {
         // directory does not exist, create it
-        if(mkdir(SD_CARD_PRG_PATH, 0775) != 0) {
+        if (mkdir(SD_CARD_PRG_PATH, 0775) != 0) {
             ESP_LOGE(TAG, "Failed to create directory %s", SD_CARD_PRG_PATH);
-            return false;
+            unmount();
+            return ESP_FAIL;
         }
         ESP_LOGE(TAG, "PRG directory has been created: %s", SD_CARD_PRG_PATH);
     } else if (!S_ISDIR(st.st_mode)) {
         ESP_LOGE(TAG, "%s is not a directory", SD_CARD_PRG_PATH);
-        return false;
+        unmount();
+        return ESP_FAIL;
     } else {
-        ESP_LOGI(TAG, "Found prg directory: %s" , SD_CARD_PRG_PATH);
+        ESP_LOGI(TAG, "Found prg directory: %s", SD_CARD_PRG_PATH);
     }
+    recoverSaves();
+    return ESP_OK;
+}
 
-    initialized = true;
-    return true;
-#else
-    return false;
-#endif
+void SDCard::unmount() {
+    esp_vfs_fat_sdcard_unmount(SD_CARD_MOUNT_POINT, mount_card);
+    mount_card = nullptr;
 }
 
-void getPath(char* path, uint8_t* ram) {
-    uint8_t  cury      = ram[0xd6];
-    uint8_t  curx      = ram[0xd3];
-    uint8_t* cursorpos = ram + 0x0400 + cury * 40 + curx;
+// No new file system users once the state is ABSENT, the card is unmounted when the current ones are done
+void SDCard::removed() {
+    state = State::ABSENT;
+    while (fsUsers.load() != 0) {
+        vTaskDelay(1);
+    }
+    if (listDir != nullptr) {
+        closedir(listDir);
+        listDir = nullptr;
+    }
+    unmount();
+}
+
+// Get the word left of the cursor on the C64 screen, converted to ASCII (at most 16 characters)
+void getScreenName(char* name, const uint8_t* ram) {
+    uint8_t        cury      = ram[0xd6];
+    uint8_t        curx      = ram[0xd3];
+    const uint8_t* cursorpos = ram + 0x0400 + cury * 40 + curx;
     cursorpos--;  // char may be 160
     while (*cursorpos == 32) {
         cursorpos--;
@@ -130,148 +227,256 @@ void getPath(char* path, uint8_t* ram) {
         cursorpos--;
     }
     cursorpos++;
-    path[0]   = '/';
-    uint8_t i = 1;
+    uint8_t i = 0;
     uint8_t p;
-    while (((p = *cursorpos++) != 32) && (p != 160) && (i < 17)) {
+    while (((p = *cursorpos++) != 32) && (p != 160) && (i < 16)) {
         if ((p >= 1) && (p <= 26)) {
-            path[i] = p + 96;
+            name[i++] = p + 96;
         } else if ((p >= 33) && (p <= 63)) {
-            path[i] = p;
+            name[i++] = p;
         }
-        i++;
     }
-    path[i++] = '.';
-    path[i++] = 'p';
-    path[i++] = 'r';
-    path[i++] = 'g';
-    path[i]   = '\0';
+    name[i] = '\0';
 }
 
-uint16_t SDCard::load(const char* path, uint8_t* ram, size_t len) {
-    char full_path[128];
-    snprintf(full_path, sizeof(full_path), "%s%s", SD_CARD_PRG_PATH, path);
-    int fd = open(full_path, O_RDONLY);
-    if (fd < 0) return 0;
+void getPath(char* path, uint8_t* ram) {
+    path[0] = '/';
+    getScreenName(path + 1, ram);
+    strcat(path, ".prg");
+}
 
-    uint8_t hdr[2];
-    if (read(fd, hdr, 2) != 2) {
-        close(fd);
-        return 0;
+// Load a PRG file into the C64 RAM, to its load address or to addr if given. The file comes from the file cache,
+// only the first load reads it from the card. Returns false on error, endaddr is the address after the last byte
+// loaded (0 for a file that ends at $ffff).
+bool SDCard::loadPrgFile(const char* full_path, uint8_t* ram, uint16_t& endaddr, int32_t addr) {
+    FsUse use(*this);
+    if (!use) return false;
+    int64_t        starttime = esp_timer_get_time();
+    size_t         filesize;
+    const uint8_t* data = getFileCache().get(full_path, filesize);
+    if ((data == nullptr) || (filesize < 2)) return false;
+
+    if (addr < 0) {
+        addr = data[0] | (data[1] << 8);
     }
-    uint16_t addr = hdr[0] | (hdr[1] << 8);
-    uint16_t pos  = addr;
-    while (read(fd, &ram[pos], 1) == 1) pos++;
-    close(fd);
-    return pos;
+    size_t size = filesize - 2;
+    if (size > 0x10000 - addr) {
+        ESP_LOGW(TAG, "%s does not fit into memory, truncated to %d bytes", full_path, (int)(0x10000 - addr));
+        size = 0x10000 - addr;
+    }
+    memcpy(&ram[addr], data + 2, size);
+    ESP_LOGI(TAG, "loaded %s: %d bytes to $%04x in %d us", full_path, (int)size, (int)addr,
+             (int)(esp_timer_get_time() - starttime));
+    endaddr = addr + size;
+    return true;
 }
 
-uint16_t SDCard::load_auto(const char* path, uint8_t* ram, size_t len) {
+// Contents of a file from the file cache, see FileCache::get
+const uint8_t* SDCard::readFile(const char* full_path, size_t& size) {
+    FsUse use(*this);
+    if (!use) return nullptr;
+    return getFileCache().get(full_path, size);
+}
+
+bool SDCard::writeFile(const char* full_path, const std::function<bool(FILE*)>& writer) {
+    FsUse use(*this);
+    if (!use) return false;
+    FILE* out = fopen(full_path, "w");
+    if (out == nullptr) return false;
+    bool ok = writer(out);
+    return (fclose(out) == 0) && ok;
+}
+
+bool SDCard::takeCacheStats(uint32_t& hits, uint32_t& misses, uint32_t& bytes) {
+    return fileCache.takeStats(hits, misses, bytes);
+}
+
+bool SDCard::load(const char* path, uint8_t* ram, uint16_t& endaddr, int32_t addr) {
+    char full_path[128];
+    snprintf(full_path, sizeof(full_path), "%s%s", SD_CARD_PRG_PATH, path);
+    return loadPrgFile(full_path, ram, endaddr, addr);
+}
+
+bool SDCard::load_auto(const char* path, uint8_t* ram, uint16_t& endaddr, size_t len) {
     char file_path[64] = {0};
-    if (!initialized) return 0;
+    if (!isReady()) return false;
     getPath(file_path, ram);
     ESP_LOGI(TAG, "load file %s", path);
 
     char full_path[128];
     snprintf(full_path, sizeof(full_path), "%s%s", SD_CARD_PRG_PATH, file_path);
-    int fd = open(full_path, O_RDONLY);
-    if (fd < 0) return 0;
+    return loadPrgFile(full_path, ram, endaddr);
+}
 
-    uint8_t hdr[2];
-    if (read(fd, hdr, 2) != 2) {
-        close(fd);
-        return 0;
+bool SDCard::postSave(const char* name, const uint8_t* ram, uint16_t start, uint16_t end,
+                      std::function<void(bool)> onDone) {
+    if (!isReady() || (saveQueue == nullptr) || (end < start)) return false;
+    SaveJob* job = new SaveJob;
+    job->path    = std::string(SD_CARD_PRG_PATH) + "/" + name + ".prg";
+    job->size    = end - start + 2;
+    job->data    = (uint8_t*)heap_caps_malloc(job->size, MALLOC_CAP_SPIRAM);
+    job->ok      = false;
+    job->onDone  = onDone;
+    if (job->data == nullptr) {
+        delete job;
+        return false;
     }
-    uint16_t addr = hdr[0] | (hdr[1] << 8);
-    uint16_t pos  = addr;
-    while (read(fd, &ram[pos], 1) == 1) pos++;
-    close(fd);
-    return pos;
+    job->data[0] = start & 0xff;
+    job->data[1] = start >> 8;
+    memcpy(job->data + 2, &ram[start], end - start);
+    if (xQueueSend(saveQueue, &job, 0) != pdTRUE) {
+        heap_caps_free(job->data);
+        delete job;
+        return false;
+    }
+    getFileCache().invalidate(job->path.c_str());
+    return true;
 }
 
-bool SDCard::save(const char* path, const uint8_t* ram, size_t len) {
-    if (!initialized) return false;
-    getPath(const_cast<char*>(path), const_cast<uint8_t*>(ram));
-    uint16_t startaddr = ram[43] + ram[44] * 256;
-    uint16_t endaddr   = ram[45] + ram[46] * 256;
-    ESP_LOGI(TAG, "save file %s", path);
+void SDCard::pollSaves() {
+    SaveJob* job;
+    while ((doneQueue != nullptr) && (xQueueReceive(doneQueue, &job, 0) == pdTRUE)) {
+        getFileCache().invalidate(job->path.c_str());
+        if (job->onDone) {
+            job->onDone(job->ok);
+        }
+        delete job;
+    }
+}
 
-    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if (fd < 0) return false;
+// Crash safe write on the SD task: the data goes to name.prg.tmp, which is renamed to name.prg.new once it is
+// complete and synced, and finally replaces name.prg. recoverSaves() completes or drops interrupted saves.
+bool SDCard::writeSave(const SaveJob& job) {
+    int64_t     starttime = esp_timer_get_time();
+    std::string tmpPath   = job.path + ".tmp";
+    std::string newPath   = job.path + ".new";
 
-    write(fd, &ram[43], 2);
-    write(fd, &ram[startaddr], endaddr - startaddr);
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "cannot create %s", tmpPath.c_str());
+        return false;
+    }
+    bool ok = (write(fd, job.data, job.size) == (ssize_t)job.size) && (fsync(fd) == 0);
     close(fd);
+    ok = ok && (rename(tmpPath.c_str(), newPath.c_str()) == 0);
+    if (!ok) {
+        ESP_LOGE(TAG, "error writing %s", tmpPath.c_str());
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    // FAT can not rename onto an existing file
+    unlink(job.path.c_str());
+    if (rename(newPath.c_str(), job.path.c_str()) != 0) {
+        ESP_LOGE(TAG, "cannot rename %s", newPath.c_str());
+        return false;
+    }
+    prgDirChanged = true;
+    ESP_LOGI(TAG, "saved %s: %d bytes in %d ms", job.path.c_str(), (int)job.size,
+             (int)((esp_timer_get_time() - starttime) / 1000));
     return true;
 }
 
-std::vector<std::string> SDCard::listPagedEntries(const char* path, size_t page, size_t pageSize) {
-    std::vector<std::string> result;
-    DIR*                     dir = nullptr;
+void SDCard::recoverSaves() {
+    DIR* dir = opendir(SD_CARD_PRG_PATH);
+    if (!dir) return;
+    std::vector<std::string> names;
     struct dirent*           ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        size_t len = strlen(ent->d_name);
+        if ((len > 8) && ((strcmp(ent->d_name + len - 8, ".prg.tmp") == 0) ||
+                          (strcmp(ent->d_name + len - 8, ".prg.new") == 0))) {
+            names.push_back(ent->d_name);
+        }
+    }
+    closedir(dir);
+    for (const std::string& name : names) {
+        std::string path = std::string(SD_CARD_PRG_PATH) + "/" + name;
+        if (name.compare(name.size() - 4, 4, ".tmp") == 0) {
+            // incomplete
+            unlink(path.c_str());
+            ESP_LOGI(TAG, "dropped interrupted save %s", path.c_str());
+        } else {
+            // complete, but not yet renamed
+            std::string prgPath = path.substr(0, path.size() - 4);
+            unlink(prgPath.c_str());
+            rename(path.c_str(), prgPath.c_str());
+            ESP_LOGI(TAG, "completed interrupted save %s", prgPath.c_str());
+        }
+    }
+}
 
-    if (!initialized) return result;
-
-    // calculate the start offset
-    size_t startOffset = page * pageSize;
-
-    ESP_LOGI(TAG, "list paged entries %s, page %zu, pageSize %zu", path, page, pageSize);
-
-    dir = opendir(path);
-    if (!dir) {
-        ESP_LOGI(TAG, "cannot open root dir");
-        closedir(dir);
-        return result;
+// Index of the PRG directory, rebuilt when its contents may have changed. Empty while no card is mounted.
+const DirIndex* SDCard::getPrgIndex() {
+    FsUse use(*this);
+    if (!use) {
+        prgIndex.clear();
+        return &prgIndex;
+    }
+    uint32_t mounted = mountCount.load();
+    if (prgDirChanged.exchange(false) || (mounted != indexMountCount)) {
+        prgIndex.invalidate();
+        indexMountCount = mounted;
     }
+    prgIndex.refresh(SD_CARD_PRG_PATH);
+    return &prgIndex;
+}
 
-    // Move the directory to the start offset
-    for (uint16_t count = 0; count < startOffset; count++) {
-        if (readdir(dir) == nullptr) {
-            closedir(dir);
-            return result;
-        }
+// The file cache is dropped when a card was (re)mounted, it may be a different card
+FileCache& SDCard::getFileCache() {
+    uint32_t mounted = mountCount.load();
+    if (mounted != cacheMountCount) {
+        fileCache.clear();
+        cacheMountCount = mounted;
     }
+    return fileCache;
+}
 
-    // Read the next page of entries until either the end of the
-    // directory or the desired page size is reached
-    uint32_t count = 0;
-    while (count < pageSize) {
-        ent = readdir(dir);
-        if (ent == nullptr) {
-            break;
-        }
-        // if the name > 4 characters and ends with.prg, cut off '.prg' and add it to the result
-        std::string name = ent->d_name;
-        if (name.length() > 4 && name.substr(name.length() - 4) == ".prg") {
-            name = name.substr(0, name.length() - 4);
-            result.push_back(name);
+// Name (without extension) of the first PRG file whose name starts with prefix, case insensitive
+bool SDCard::findPrg(const char* prefix, std::string& name) {
+    FsUse use(*this);
+    if (!use) return false;
+    DIR* dir = opendir(SD_CARD_PRG_PATH);
+    if (!dir) return false;
+    size_t         prefixLen = strlen(prefix);
+    bool           found     = false;
+    struct dirent* ent;
+    while (!found && ((ent = readdir(dir)) != nullptr)) {
+        size_t len = strlen(ent->d_name);
+        if ((len > 4) && (len - 4 >= prefixLen) && (strcmp(ent->d_name + len - 4, ".prg") == 0) &&
+            (strncasecmp(ent->d_name, prefix, prefixLen) == 0)) {
+            name.assign(ent->d_name, len - 4);
+            found = true;
         }
-        count++;
     }
     closedir(dir);
-    return result;
+    return found;
 }
 
+// The directory stays open between the calls of a listing, it is closed by the mount task when the card is removed
 bool SDCard::listNextEntry(uint8_t* nextentry, size_t entrySize, bool start) {
-    static DIR*           dir = nullptr;
-    static struct dirent* ent;
+    struct dirent* ent;
 
-    if (!initialized) return false;
+    FsUse use(*this);
+    if (!use) return false;
 
     if (start) {
-        if (dir) {
-            closedir(dir);
-            dir = nullptr;
+        if (listDir) {
+            closedir(listDir);
+            listDir = nullptr;
         }
 
-        dir = opendir(SD_CARD_PRG_PATH);
-        if (!dir) {
+        listDir = opendir(SD_CARD_PRG_PATH);
+        if (!listDir) {
             ESP_LOGI(TAG, "cannot open root dir");
             return false;
         }
+    } else if (!listDir) {
+        // the listing has ended or the card was changed
+        nextentry[0] = '\0';
+        return true;
     }
 
-    while ((ent = readdir(dir)) != nullptr) {
+    while ((ent = readdir(listDir)) != nullptr) {
         const char* name = ent->d_name;
         size_t      len  = strlen(name);
         ESP_LOGI(TAG, "found file: %s", name);
@@ -286,10 +491,8 @@ bool SDCard::listNextEntry(uint8_t* nextentry, size_t entrySize, bool start) {
         }
     }
 
-    if (dir) {
-        closedir(dir);
-        dir = nullptr;
-    }
+    closedir(listDir);
+    listDir      = nullptr;
     nextentry[0] = '\0';
     return true;
 }
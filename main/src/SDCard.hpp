@@ -16,30 +16,114 @@
  http://www.gnu.org/licenses/.
 */
 
+#include <dirent.h>
 #include <sys/stat.h>
+#include <atomic>
+#include <cstdio>
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
+#include "DirIndex.hpp"
+#include "FileCache.hpp"
 #include "driver/sdmmc_default_configs.h"
 #include "driver/sdmmc_host.h"
+#include "freertos/idf_additions.h"
+
+void getScreenName(char* name, const uint8_t* ram);
 
 class SDCard {
+   public:
+    enum class State : uint8_t { ABSENT, MOUNTING, READY, ERROR };
+
    private:
-    bool                initialized;
     sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
     sdmmc_host_t        host        = SDMMC_HOST_DEFAULT();
     sdmmc_card_t        card;
-    sdmmc_card_t*       mount_card;
+    sdmmc_card_t*       mount_card = nullptr;
+
+    // written by the mount task only
+    std::atomic<State>    state{State::ABSENT};
+    std::atomic<uint32_t> mountCount{0};  // number of successful mounts
+    // number of tasks accessing the file system, the mount task waits for them before unmounting
+    std::atomic<uint8_t> fsUsers{0};
+
+    // Counts a task as file system user while the card is ready, the card is not unmounted while it exists
+    class FsUse {
+       private:
+        SDCard& sdcard;
+        bool    ready;
+
+       public:
+        explicit FsUse(SDCard& sdcard);
+        ~FsUse();
+        FsUse(const FsUse&)            = delete;
+        FsUse& operator=(const FsUse&) = delete;
+        explicit operator bool() const
+        {
+            return ready;
+        }
+    };
+
+    // PRG index (UI task) and file cache (CPU task), dropped when a card is mounted
+    DirIndex          prgIndex;
+    uint32_t          indexMountCount = 0;
+    std::atomic<bool> prgDirChanged{false};
+    FileCache         fileCache;
+    uint32_t          cacheMountCount = 0;
+    DIR*              listDir         = nullptr;  // open between the listNextEntry calls of a listing, CPU task
+
+    // save written by the SD task
+    struct SaveJob {
+        std::string               path;  // full path of the PRG file
+        uint8_t*                  data;  // load address followed by the program
+        size_t                    size;
+        bool                      ok;
+        std::function<void(bool)> onDone;
+    };
+    QueueHandle_t saveQueue = nullptr;  // jobs for the SD task
+    QueueHandle_t doneQueue = nullptr;  // finished jobs for pollSaves()
+
+    static void mountTaskWrapper(void* param);
+    void        mountTask();
+    esp_err_t   mount();
+    void        unmount();
+    void        removed();
+    void        recoverSaves();
+    bool        writeSave(const SaveJob& job);
+    FileCache&  getFileCache();
+    bool        loadPrgFile(const char* full_path, uint8_t* ram, uint16_t& endaddr, int32_t addr = -1);
 
    public:
     SDCard();
     ~SDCard();
 
-    bool                     init();
-    //   uint16_t load(const char *path, uint8_t *ram, size_t len);
-    uint16_t                 load(const char* path, uint8_t* ram, size_t len = 0);
-    uint16_t                 load_auto(const char* path, uint8_t* ram, size_t len = 0);
-    bool                     save(const char* path, const uint8_t* ram, size_t len = 0);
-    std::vector<std::string> listPagedEntries(const char* path, size_t page, size_t pageSize);
+    // start the task that mounts the card in the background and detects its removal
+    void  start();
+    State getState() const
+    {
+        return state.load();
+    }
+    bool isReady() const
+    {
+        return state.load() == State::READY;
+    }
+
+    bool                     load(const char* path, uint8_t* ram, uint16_t& endaddr, int32_t addr = -1);
+    bool                     load_auto(const char* path, uint8_t* ram, uint16_t& endaddr, size_t len = 0);
+    bool                     findPrg(const char* prefix, std::string& name);
+    const DirIndex*          getPrgIndex();
+    const uint8_t*           readFile(const char* full_path, size_t& size);
+    // Create the file and let writer fill it, the card stays mounted meanwhile. Returns false if the card is not
+    // ready or the file can not be created (writer is not called), else the result of writer and of closing the file.
+    bool                     writeFile(const char* full_path, const std::function<bool(FILE*)>& writer);
+    bool                     takeCacheStats(uint32_t& hits, uint32_t& misses, uint32_t& bytes);
     bool                     listNextEntry(uint8_t* nextEntry, size_t entrySize, bool start);
+
+    // Write-behind save of the memory from start up to (excluding) end as name.prg: the data is copied and written
+    // by the SD task, onDone is called by pollSaves() with the result. Returns false if the save can not be started.
+    bool postSave(const char* name, const uint8_t* ram, uint16_t start, uint16_t end,
+                  std::function<void(bool)> onDone = nullptr);
+    // Report finished saves, to be called regularly by the task that posts saves
+    void pollSaves();
 };
@@ -18,6 +18,7 @@
 #include <cstdint>
 #include <cstring>
 #include "DisplayDriver.hpp"
+#include "Profiler.hpp"
 #include "esp_attr.h"
 #include "esp_heap_caps.h"
 #include "sid/sid.hpp"
@@ -690,6 +691,7 @@ void VIC::refresh(bool refreshframecolor)
 {
     configDisplay.displayDriver->drawBitmap(bitmap);
     configDisplay.displayDriver->drawFrame(bordercolors);
+    PROFILE_END_FRAME(PPA, DSI);
     cntRefreshs++;
 }
 
@@ -737,6 +739,7 @@ void VIC::screenHeight() {
 
 void IRAM_ATTR VIC::drawRasterline()
 {
+    PROFILE_SCOPE(VIC);
     static bool active_area = false;
 
     // uint16_t line = rasterline;
@@ -0,0 +1,113 @@
+#include "DebugMenu.hpp"
+
+#if defined(USE_DEBUGGER)
+#include <cctype>
+#include <cstdlib>
+#include "ExternalCmds.hpp"
+#include "esp_log.h"
+#include "menuoverlay/MenuController.hpp"
+
+static const char* TAG = "DebugMenu";
+
+// "c000-c0ff" has the most characters
+static const size_t RANGEMAXLEN = 9;
+
+DebugMenu::DebugMenu(std::string title, MenuBaseClass* previousMenu, MenuController* menuController)
+    : MenuBaseClass(title, previousMenu, menuController)
+{
+    c64emu    = menuController->getC64Emu();
+    menuTitle = title;
+}
+
+DebugMenu::~DebugMenu() {};
+
+// One or two hex addresses separated by '-', the range ends at its first address if there is no second one
+bool DebugMenu::parseRange(uint16_t& from, uint16_t& to) const
+{
+    const char*   start = range.c_str();
+    char*         end;
+    unsigned long first = strtoul(start, &end, 16);
+    if ((end == start) || (first > 0xffff)) {
+        return false;
+    }
+    unsigned long last = first;
+    if (*end == '-') {
+        start = end + 1;
+        last  = strtoul(start, &end, 16);
+        if ((end == start) || (last > 0xffff) || (last < first)) {
+            return false;
+        }
+    }
+    if (*end != '\0') {
+        return false;
+    }
+    from = first;
+    to   = last;
+    return true;
+}
+
+void DebugMenu::addAction(uint16_t id, const char* title, std::function<void(uint16_t, uint16_t)> command)
+{
+    MenuItem item = MenuItem();
+    item.id       = id;
+    item.title    = title;
+    item.type     = MenuItemType::ACTION;
+    item.action   = [this, command](MenuItem* item) {
+        uint16_t from;
+        uint16_t to;
+        if (!parseRange(from, to)) {
+            ESP_LOGI(TAG, "type an address or an address range first, e.g. c000 or d020-d02e");
+            return;
+        }
+        command(from, to);
+    };
+    items.push_back(item);
+}
+
+bool DebugMenu::init()
+{
+    ExternalCmds* ext      = &c64emu->externalCmds;
+    uint16_t      id_count = 0;
+
+    // breakpoints are set on the first address of a range
+    addAction(id_count++, "Set breakpoint", [ext](uint16_t from, uint16_t to) { ext->postBreakpoint(true, from); });
+    addAction(id_count++, "Clear breakpoint", [ext](uint16_t from, uint16_t to) { ext->postBreakpoint(false, from); });
+    addAction(id_count++, "Watch reads",
+              [ext](uint16_t from, uint16_t to) { ext->postWatchpoint(true, from, to, true, false); });
+    addAction(id_count++, "Watch writes",
+              [ext](uint16_t from, uint16_t to) { ext->postWatchpoint(true, from, to, false, true); });
+    addAction(id_count++, "Clear watchpoints",
+              [ext](uint16_t from, uint16_t to) { ext->postWatchpoint(false, from, to, true, true); });
+
+    MenuItem clear_all = MenuItem();
+    clear_all.id       = id_count++;
+    clear_all.title    = "Clear all";
+    clear_all.type     = MenuItemType::ACTION;
+    clear_all.action   = [ext](MenuItem* item) { ext->postClearDebugPoints(); };
+    items.push_back(clear_all);
+
+    // a hit halts the CPU until continued here
+    MenuItem debug_continue = MenuItem();
+    debug_continue.id       = id_count++;
+    debug_continue.title    = "Continue after break";
+    debug_continue.type     = MenuItemType::ACTION;
+    debug_continue.action   = [ext](MenuItem* item) { ext->postContinue(); };
+    items.push_back(debug_continue);
+
+    return true;
+}
+
+// Hex digits and '-' edit the address range shown in the title, backspace removes one character
+void DebugMenu::handleChar(char c)
+{
+    if (c == '\b') {
+        if (range.empty()) return;
+        range.erase(range.size() - 1);
+    } else if ((isxdigit((unsigned char)c) || (c == '-')) && (range.size() < RANGEMAXLEN)) {
+        range += tolower((unsigned char)c);
+    } else {
+        return;
+    }
+    title = range.empty() ? menuTitle : menuTitle + ": " + range;
+}
+#endif
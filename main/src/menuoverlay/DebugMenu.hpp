@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Config.hpp"
+
+#if defined(USE_DEBUGGER)
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "C64Emu.hpp"
+#include "MenuBaseClass.hpp"
+#include "menuoverlay/MenuTypes.hpp"
+
+// Breakpoints and watchpoints for a typed hex address resp. address range ("c000" or "d020-d02e"), the commands are
+// executed by the CPU task
+class DebugMenu : public MenuBaseClass {
+   private:
+    C64Emu*     c64emu = nullptr;
+    std::string menuTitle;
+    std::string range;  // typed address range
+
+    bool parseRange(uint16_t& from, uint16_t& to) const;
+    void addAction(uint16_t id, const char* title, std::function<void(uint16_t, uint16_t)> command);
+
+   public:
+    DebugMenu(std::string title, MenuBaseClass* previousMenu, MenuController* menuController);
+    ~DebugMenu();
+
+    bool init() override;
+    void handleChar(char c) override;
+};
+#endif
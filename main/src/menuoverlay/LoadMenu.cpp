@@ -1,6 +1,7 @@
 #include "LoadMenu.hpp"
 #include <string.h>
 #include <sys/_default_fcntl.h>
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include "C64Emu.hpp"
@@ -17,8 +18,9 @@ const static char* TAG = "LoadMenu";
 LoadMenu::LoadMenu(std::string title, MenuBaseClass* previousMenu, MenuController* menuController)
     : MenuBaseClass(title, previousMenu, menuController) {
     // Nothing else to do here
-    c64emu = menuController->getC64Emu();
-    sdcard = &c64emu->externalCmds.sdcard;
+    c64emu    = menuController->getC64Emu();
+    sdcard    = &c64emu->externalCmds.sdcard;
+    menuTitle = title;
     // Initialize SD card
     // sdcard.init();
 }
@@ -28,14 +30,22 @@ LoadMenu::~LoadMenu() {};
 std::vector<MenuItem> LoadMenu::getDirPage(uint16_t page) {
     ESP_LOGI(TAG, "Loading directory page %d", page);
 
-    auto     entries  = sdcard->listPagedEntries(SD_CARD_PRG_PATH, page, pageSize);
-    uint16_t id_count = 0;
-    for (auto& entry : entries) {
+    const DirIndex* index    = sdcard->getPrgIndex();
+    size_t          start    = page * pageSize;
+    size_t          end      = std::min(start + pageSize, index->size());
+    uint16_t        id_count = 0;
+    for (size_t i = start; i < end; i++) {
         MenuItem item = MenuItem();
         item.id       = id_count++;
-        item.title    = entry;
         item.type     = MenuItemType::ACTION;
-        item.action   = [this](MenuItem* item) { this->loadPrg(item); };
+        if (index->getEntry(i).type == DirIndex::TYPE_D64) {
+            std::string name = index->getName(i);
+            item.title       = name + " [d64]";
+            item.action      = [this, name](MenuItem* item) { this->mountD64(name); };
+        } else {
+            item.title  = index->getName(i);
+            item.action = [this](MenuItem* item) { this->loadPrg(item); };
+        }
         this->items.push_back(item);
     }
 
@@ -56,6 +66,28 @@ void LoadMenu::toPrevPage() {
     ESP_LOGI(TAG, "Loading previous page %d", nextPage);
 }
 
+// Typed characters narrow down a name prefix and jump to the first file matching it, backspace removes one
+void LoadMenu::handleChar(char c) {
+    if (c == '\b') {
+        if (filter.empty()) return;
+        filter.erase(filter.size() - 1);
+    } else if ((c >= 0x20) && (c < 0x7f)) {
+        filter += c;
+    } else {
+        return;
+    }
+    title = filter.empty() ? menuTitle : menuTitle + ": " + filter;
+
+    const DirIndex* index = sdcard->getPrgIndex();
+    size_t          match = index->findPrefix(filter.c_str());
+    if (match >= index->size()) {
+        return;
+    }
+    currentPage = nextPage = match / pageSize;
+    displayMenu();
+    selectItem((currentPage != 0 ? 1 : 0) + match % pageSize);
+}
+
 void LoadMenu::displayMenu() {
     // Free any existing menu items
     items.clear();
@@ -71,41 +103,62 @@ void LoadMenu::displayMenu() {
     }
 
     // Load the next page of menu items
+    if (!sdcard->isReady()) {
+        MenuItem noCardItem = MenuItem();
+        noCardItem.id       = 0;
+        noCardItem.title    = (sdcard->getState() == SDCard::State::ERROR) ? "SD card error" : "No SD card";
+        noCardItem.type     = MenuItemType::ACTION;
+        noCardItem.disabled = true;
+        this->items.push_back(noCardItem);
+    }
     this->items = getDirPage(currentPage);
 
     // Display the menu
-    MenuItem nextPageItem = MenuItem();
-    nextPageItem.id       = 20;
-    nextPageItem.title    = "=== Next Page ===";
-    nextPageItem.type     = MenuItemType::ACTION;
-    nextPageItem.action   = [this](MenuItem* item) { this->toNextPage(); };
-    this->items.push_back(nextPageItem);
+    if ((currentPage + 1) * pageSize < sdcard->getPrgIndex()->size()) {
+        MenuItem nextPageItem = MenuItem();
+        nextPageItem.id       = 20;
+        nextPageItem.title    = "=== Next Page ===";
+        nextPageItem.type     = MenuItemType::ACTION;
+        nextPageItem.action   = [this](MenuItem* item) { this->toNextPage(); };
+        this->items.push_back(nextPageItem);
+    }
 }
 
 void LoadMenu::loadPrg(MenuItem* item) {
     ExternalCmds* ext = &c64emu->externalCmds;
 
-    // First reset the C64
-    ext->reset();
-    vTaskDelay(3000 / portTICK_PERIOD_MS);  // ~1second
-    // Load the program
-    ext->loadPrg(item->title.c_str());
-    vTaskDelay(1000 / portTICK_PERIOD_MS);  // ~1second
+    // The CPU task resets the C64 and loads the program when the KERNAL has booted
+    std::string filename = item->title;
+    ext->postLoadPrg(filename.c_str(), true, [filename](uint8_t loaded) {
+        ESP_LOGI(TAG, "%s %s", filename.c_str(), loaded ? "loaded" : "not loaded");
+    });
+    menuController->hide();
+}
+
+void LoadMenu::mountD64(const std::string& name) {
+    ExternalCmds* ext = &c64emu->externalCmds;
+
+    // Reset, then mount the image and load its first program, further files can be loaded from the mounted image
+    ext->postMountD64(name.c_str(), true, [name](uint8_t loaded) {
+        ESP_LOGI(TAG, "%s mounted, first program %s", name.c_str(), loaded ? "loaded" : "not loaded");
+    });
     menuController->hide();
 }
 
 void LoadMenu::update() {
     ESP_LOGI(TAG, "Updating load menu");
-    if (currentPage != nextPage) {
+    // also redisplay when the SD card was inserted or removed
+    if ((currentPage != nextPage) || (cardReady != sdcard->isReady())) {
         currentPage = nextPage;
+        cardReady   = sdcard->isReady();
         displayMenu();
     }
 }
 
 bool LoadMenu::init() {
-    sdcard->init();
     ESP_LOGI(TAG, "Initializing load menu...");
     // // Setup the menu entries
+    cardReady = sdcard->isReady();
     displayMenu();
 
     return true;
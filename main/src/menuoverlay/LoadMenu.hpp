@@ -10,9 +10,13 @@ class LoadMenu : public MenuBaseClass {
     std::vector<MenuItem> getDirPage(uint16_t page);
     void                  displayMenu() const;
     void                  loadPrg(MenuItem* item);
+    void                  mountD64(const std::string& name);
     uint16_t              currentPage = 0;
     uint16_t              nextPage    = 0;
     size_t                pageSize    = 12;
+    std::string           menuTitle;
+    std::string           filter;  // typed name prefix
+    bool                  cardReady = false;
 
    public:
     LoadMenu(std::string title, MenuBaseClass* previousMenu, MenuController* menuController);
@@ -25,5 +29,5 @@ class LoadMenu : public MenuBaseClass {
     void toPrevPage();
     void toNextPage();
     void displayMenu();
-    void handleInput(char input);
+    void handleChar(char c) override;
 };
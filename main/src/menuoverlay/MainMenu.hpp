@@ -6,12 +6,19 @@
 #include "MenuDataStore.hpp"
 
 class LoadMenu;
+class DebugMenu;
 
 class MainMenu : public MenuBaseClass {
    private:
     C64Emu*   c64emu = nullptr;
     LoadMenu* loadMenu;
     void      resetC64(MenuItem* item);
+#if defined(USE_EVENTTRACE)
+    void saveEventTrace();
+#endif
+#if defined(USE_DEBUGGER)
+    DebugMenu* debugMenu;
+#endif
     MenuDataStore* menuDataStore = MenuDataStore::getInstance();
 
    public:
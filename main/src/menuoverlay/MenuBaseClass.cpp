@@ -26,6 +26,11 @@ void MenuBaseClass::update() {
     // Implement logic to update the menu items based on user input
 };
 
+void MenuBaseClass::handleChar(char c)
+{
+    // Menus without text input ignore typed characters
+}
+
 std::string MenuBaseClass::getTitle() const
 {
     return title;
@@ -66,6 +71,13 @@ void MenuBaseClass::navigateDown()
     // menuController->render();
 }
 
+void MenuBaseClass::selectItem(size_t index)
+{
+    if (index < items.size()) {
+        selectedItemIndex = index;
+    }
+}
+
 size_t MenuBaseClass::getSelectedItemIndex() const
 {
     return selectedItemIndex;
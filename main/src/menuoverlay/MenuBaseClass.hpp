@@ -19,6 +19,8 @@ class MenuBaseClass {
     MenuController*       menuController;
     std::vector<MenuItem> items;
 
+    void selectItem(size_t index);
+
    public:
     MenuBaseClass(std::string title, MenuBaseClass* previousMenu = nullptr, MenuController* menuController = nullptr);
 
@@ -32,6 +34,9 @@ class MenuBaseClass {
 
     virtual void update();
 
+    // Printable characters and backspace typed while the menu is shown
+    virtual void handleChar(char c);
+
     std::string getTitle() const;
 
     // Menu structure
@@ -120,4 +120,10 @@ void MenuController::handleInput(menu_overlay_input_type_t input)
     render();
 }
 
+void MenuController::handleChar(char c)
+{
+    currentMenu->handleChar(c);
+    render();
+}
+
 // Implement other methods defined in MenuController.hpp
\ No newline at end of file
@@ -31,6 +31,7 @@ class MenuController {
 
     void init(C64Emu* c64emu);
     void handleInput(menu_overlay_input_type_t type);
+    void handleChar(char c);
 
     // Render the current menu to the framebuffer and update the display
     void render();
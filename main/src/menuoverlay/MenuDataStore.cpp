@@ -30,6 +30,30 @@ MenuDataStoreValue& MenuDataStoreValue::operator=(const MenuDataStoreValue& othe
     return *this;
 }
 
+bool MenuDataStoreValue::get(bool& out) const {
+    if (type != BOOL) {
+        return false;
+    }
+    out = b;
+    return true;
+}
+
+bool MenuDataStoreValue::get(int& out) const {
+    if (type != INT) {
+        return false;
+    }
+    out = i;
+    return true;
+}
+
+bool MenuDataStoreValue::get(std::string& out) const {
+    if (type != STRING) {
+        return false;
+    }
+    out = s;
+    return true;
+}
+
 MenuDataStore *MenuDataStore::instance = nullptr;
 
 MenuDataStore* MenuDataStore::getInstance() {
@@ -39,35 +63,65 @@ MenuDataStore* MenuDataStore::getInstance() {
     return instance;
 }
 
+MenuDataStore::Slot MenuDataStore::getSlot(const std::string& key) {
+    auto it = slotIds.find(key);
+    if (it != slotIds.end()) {
+        return it->second;
+    }
+    Slot slot = slots.size();
+    slots.emplace_back();
+    slotIds[key] = slot;
+    return slot;
+}
+
+void MenuDataStore::set(Slot slot, const MenuDataStoreValue& value) {
+    SlotEntry& entry = slots[slot];
+    entry.isSet = true;
+    entry.value = value;
+    for (auto& listener : entry.listeners) {
+        listener(entry.value);
+    }
+}
+
+const MenuDataStoreValue* MenuDataStore::get(Slot slot) const {
+    return slots[slot].isSet ? &slots[slot].value : nullptr;
+}
+
+void MenuDataStore::addListener(Slot slot, Listener listener) {
+    slots[slot].listeners.push_back(listener);
+}
+
 void MenuDataStore::set(const std::string& key, bool value) {
-    store[key] = MenuDataStoreValue(value);
+    set(getSlot(key), MenuDataStoreValue(value));
 }
 
 void MenuDataStore::set(const std::string& key, int value) {
-    store[key] = MenuDataStoreValue(value);
+    set(getSlot(key), MenuDataStoreValue(value));
 }
 
 void MenuDataStore::set(const std::string& key, const std::string& value) {
-    store[key] = MenuDataStoreValue(value);
+    set(getSlot(key), MenuDataStoreValue(value));
 }
 
 void MenuDataStore::set(const std::string& key, const char* value) {
-    store[key] = MenuDataStoreValue(value);
+    set(getSlot(key), MenuDataStoreValue(value));
 }
 
 bool MenuDataStore::getBool(const std::string& key, bool defaultVal) const {
-    // if empty key, raise exception
-    auto it = store.find(key);
+    auto it = slotIds.find(key);
+    const MenuDataStoreValue* value = (it != slotIds.end()) ? get(it->second) : nullptr;
     // return value if found and type is bool, else return default value
-    return (it != store.end() && it->second.type == MenuDataStoreValue::BOOL) ? it->second.b : defaultVal;
+    return (value != nullptr && value->type == MenuDataStoreValue::BOOL) ? value->b : defaultVal;
 }
 
 int MenuDataStore::getInt(const std::string& key, int defaultVal) const {
-    auto it = store.find(key);
-    return (it != store.end() && it->second.type == MenuDataStoreValue::INT) ? it->second.i : defaultVal;
+    auto it = slotIds.find(key);
+    const MenuDataStoreValue* value = (it != slotIds.end()) ? get(it->second) : nullptr;
+    return (value != nullptr && value->type == MenuDataStoreValue::INT) ? value->i : defaultVal;
 }
 
 std::string MenuDataStore::getString(const std::string& key, const std::string& defaultVal) const {
-    auto it = store.find(key);
-    return (it != store.end() && it->second.type == MenuDataStoreValue::STRING) ? it->second.s : defaultVal;
+    auto it = slotIds.find(key);
+    const MenuDataStoreValue* value = (it != slotIds.end()) ? get(it->second) : nullptr;
+    return (value != nullptr && value->type == MenuDataStoreValue::STRING) ? value->s : defaultVal;
 }
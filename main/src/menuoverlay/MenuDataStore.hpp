@@ -1,8 +1,10 @@
 #ifndef DATASTORE_HPP
 #define DATASTORE_HPP
 
+#include <functional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 class MenuDataStoreValue {
 public:
@@ -22,11 +24,26 @@ public:
     MenuDataStoreValue(const char* val);
     MenuDataStoreValue(const MenuDataStoreValue& other);
     MenuDataStoreValue& operator=(const MenuDataStoreValue& other);
+
+    // copy the value to out if it has the matching type
+    bool get(bool& out) const;
+    bool get(int& out) const;
+    bool get(std::string& out) const;
 };
 
+// Not thread safe: values are only set by the input task, which also runs the menu. Other tasks forward changes to it.
 class MenuDataStore {
 public:
+    // Pre-resolved key, valid for the lifetime of the store
+    typedef int Slot;
+    typedef std::function<void(const MenuDataStoreValue&)> Listener;
 
+    Slot getSlot(const std::string& key);
+    void set(Slot slot, const MenuDataStoreValue& value);
+    // nullptr if the value was never set
+    const MenuDataStoreValue* get(Slot slot) const;
+    // called on every set of the slot, from the task that sets it
+    void addListener(Slot slot, Listener listener);
 
     void set(const std::string& key, bool value);
     void set(const std::string& key, int value);
@@ -49,7 +66,45 @@ protected:
     MenuDataStore(MenuDataStore &other) = delete;
     void operator=(MenuDataStore &other) = delete;
 private:
-    std::unordered_map<std::string, MenuDataStoreValue> store;
+    struct SlotEntry {
+        bool isSet = false;
+        MenuDataStoreValue value;
+        std::vector<Listener> listeners;
+    };
+
+    std::unordered_map<std::string, Slot> slotIds;
+    std::vector<SlotEntry> slots;
+};
+
+// Typed handle for a value in the store. The value is cached in a plain field that is updated on every change, so
+// reading it is as cheap as reading a member variable.
+template <typename T>
+class MenuSetting {
+public:
+    MenuSetting(const std::string& key, T defaultVal, std::function<void(T)> onChange = nullptr)
+        : value(defaultVal), onChange(onChange) {
+        MenuDataStore* store = MenuDataStore::getInstance();
+        slot = store->getSlot(key);
+        const MenuDataStoreValue* current = store->get(slot);
+        if (current != nullptr) {
+            current->get(value);
+        }
+        store->addListener(slot, [this](const MenuDataStoreValue& newValue) {
+            if (newValue.get(value) && this->onChange) {
+                this->onChange(value);
+            }
+        });
+    }
+    MenuSetting(const MenuSetting& other) = delete;
+    void operator=(const MenuSetting& other) = delete;
+
+    T get() const { return value; }
+    void set(T newValue) { MenuDataStore::getInstance()->set(slot, MenuDataStoreValue(newValue)); }
+
+private:
+    MenuDataStore::Slot slot;
+    T value;
+    std::function<void(T)> onChange;
 };
 
 #endif // DATASTORE_HPP
\ No newline at end of file
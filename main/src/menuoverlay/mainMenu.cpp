@@ -1,7 +1,11 @@
 #include "MainMenu.hpp"
 #include "C64Emu.hpp"
+#include "DebugMenu.hpp"
 #include "LoadMenu.hpp"
+#include "EventTrace.hpp"
 #include "MenuDataStore.hpp"
+#include "Profiler.hpp"
+#include "RasterTracer.hpp"
 #include "esp_log.h"
 #include "menuoverlay/MenuController.hpp"
 #include "menuoverlay/MenuDataStore.hpp"
@@ -11,6 +15,14 @@ extern "C" {
 #include "bsp/audio.h"
 }
 
+// SID samplerates selectable in the menu, the first one is the default
+static const int sampleRates[] = {22050, 32000, 44100, 48000};
+
+static std::string sampleRateTitle(int rate)
+{
+    return "sid samplerate: " + std::to_string(rate) + " Hz";
+}
+
 MainMenu::MainMenu(std::string title, MenuBaseClass* previousMenu, MenuController* menuController)
     : MenuBaseClass(title, previousMenu, menuController)
 {
@@ -20,11 +32,31 @@ MainMenu::MainMenu(std::string title, MenuBaseClass* previousMenu, MenuControlle
 
 MainMenu::~MainMenu() {};
 
+#if defined(USE_EVENTTRACE)
+void MainMenu::saveEventTrace()
+{
+    static const char* path = SD_CARD_MOUNT_POINT "/trace.json";
+
+    // written through the SD card, so the card is not unmounted while the file is open
+    bool exported = false;
+    bool ok       = c64emu->externalCmds.sdcard.writeFile(path, [&exported](FILE* out) {
+        exported = true;
+        return EventTrace::exportJson(out);
+    });
+    if (exported) {
+        ESP_LOGI("MainMenu", "event trace %s %s", ok ? "saved to" : "error writing", path);
+    } else {
+        EventTrace::exportJson(stdout);
+        fflush(stdout);
+    }
+}
+#endif
+
 void MainMenu::resetC64(MenuItem* item)
 {
     ExternalCmds* ext = &c64emu->externalCmds;
 
-    ext->reset();
+    ext->postReset();
 }
 
 bool MainMenu::init()
@@ -43,6 +75,14 @@ bool MainMenu::init()
     load_prg->submenu  = loadMenu;
     items.push_back(*load_prg);
 
+    // LOAD uses the PRG directory again, also done by a reset, loading a PRG and removing the card
+    MenuItem* eject_disk = new MenuItem();
+    eject_disk->id       = id_count++;
+    eject_disk->title    = "Eject disk";
+    eject_disk->type     = MenuItemType::ACTION;
+    eject_disk->action   = [this](MenuItem* item) { this->c64emu->externalCmds.postEjectD64(); };
+    items.push_back(*eject_disk);
+
     // Separator
     MenuItem* sep1 = new MenuItem();
     sep1->id       = id_count++;
@@ -73,6 +113,26 @@ bool MainMenu::init()
     };
     items.push_back(*speaker_emu);
 
+    // SID samplerate, higher rates sound cleaner but cost more CPU time
+    MenuItem* sample_rate   = new MenuItem();
+    sample_rate->id         = id_count++;
+    sample_rate->title      = sampleRateTitle(sampleRates[0]);
+    sample_rate->type       = MenuItemType::ACTION;
+    sample_rate->value_name = "sid_samplerate";
+    menuDataStore->set("sid_samplerate", sampleRates[0]);
+    sample_rate->action = [this, menuDataStore](MenuItem* item) {
+        int    rate = menuDataStore->getInt("sid_samplerate", sampleRates[0]);
+        size_t i    = 0;
+        while (i < sizeof(sampleRates) / sizeof(sampleRates[0]) - 1 && sampleRates[i] != rate) {
+            i++;
+        }
+        rate = sampleRates[(i + 1) % (sizeof(sampleRates) / sizeof(sampleRates[0]))];
+        menuDataStore->set("sid_samplerate", rate);
+        item->title = sampleRateTitle(rate);
+        this->c64emu->setSampleRate(rate);
+    };
+    items.push_back(*sample_rate);
+
     // Separator
     MenuItem* sep3 = new MenuItem();
     sep3->id       = id_count++;
@@ -100,5 +160,68 @@ bool MainMenu::init()
     };
     items.push_back(*perf_mon);
 
+    // Sampling profiler of the running C64 program, switching it off logs the report
+    MenuItem* pc_sampler   = new MenuItem();
+    pc_sampler->id         = id_count++;
+    pc_sampler->title      = "Guest profiler: ";
+    pc_sampler->type       = MenuItemType::TOGGLE;
+    pc_sampler->value_name = "pc_sampler_ena";
+    menuDataStore->set("pc_sampler_ena", false);
+    pc_sampler->action = [this, menuDataStore](MenuItem* item) {
+        if (menuDataStore->getBool("pc_sampler_ena", false)) {
+            this->c64emu->cpu.pcSampler.requestStart(Config::PCSAMPLERINTERVAL);
+        } else {
+            this->c64emu->cpu.pcSampler.requestReport();
+        }
+    };
+    items.push_back(*pc_sampler);
+
+#if defined(USE_PROFILER)
+    // Profiler statistics on top of the C64 screen
+    MenuItem* profiler_hud   = new MenuItem();
+    profiler_hud->id         = id_count++;
+    profiler_hud->title      = "Profiler HUD: ";
+    profiler_hud->type       = MenuItemType::TOGGLE;
+    profiler_hud->value_name = "profiler_hud_ena";
+    menuDataStore->set("profiler_hud_ena", false);
+    profiler_hud->action = [menuDataStore](MenuItem* item) {
+        Profiler::hudEnabled = menuDataStore->getBool("profiler_hud_ena", false);
+    };
+    items.push_back(*profiler_hud);
+#endif
+
+#if defined(USE_RASTERTRACER)
+    // Worst frames of the raster line tracer as CSV to the console
+    MenuItem* raster_trace = new MenuItem();
+    raster_trace->id       = id_count++;
+    raster_trace->title    = "Dump raster trace";
+    raster_trace->type     = MenuItemType::ACTION;
+    raster_trace->action   = [](MenuItem* item) { RasterTracer::requestDump(); };
+    items.push_back(*raster_trace);
+#endif
+
+#if defined(USE_EVENTTRACE)
+    // Recent task events as Chrome trace JSON, to the SD card if there is one, else to the console
+    MenuItem* event_trace = new MenuItem();
+    event_trace->id       = id_count++;
+    event_trace->title    = "Save event trace";
+    event_trace->type     = MenuItemType::ACTION;
+    event_trace->action   = [this](MenuItem* item) { this->saveEventTrace(); };
+    items.push_back(*event_trace);
+#endif
+
+#if defined(USE_DEBUGGER)
+    // Breakpoints and watchpoints, a hit halts the CPU until continued in this menu
+    debugMenu = new DebugMenu("Debugger", this, menuController);
+    debugMenu->init();
+
+    MenuItem* debugger = new MenuItem();
+    debugger->id       = id_count++;
+    debugger->title    = "Debugger";
+    debugger->type     = MenuItemType::SUBMENU;
+    debugger->submenu  = debugMenu;
+    items.push_back(*debugger);
+#endif
+
     return true;
 }
@@ -6,6 +6,8 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "hal/i2s_types.h"
+#include "EventTrace.hpp"
+#include "Profiler.hpp"
 #include "sid/sid.hpp"
 
 extern "C" {
@@ -41,7 +43,7 @@ esp_err_t I2S::init()
 
 
     i2s_std_config_t i2s_config = {
-        .clk_cfg  = I2S_STD_CLK_DEFAULT_CONFIG((uint32_t)DEFAULT_SAMPLERATE),
+        .clk_cfg  = I2S_STD_CLK_DEFAULT_CONFIG(I2S_SAMPLERATE),
         .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
         .gpio_cfg =
             {
@@ -83,13 +85,22 @@ union MonoToStereo {
     };
 };
 
-esp_err_t I2S::write(const int16_t* data, size_t size)
+esp_err_t I2S::write(const int16_t* data, size_t size, uint32_t samplerate)
 {
+    PROFILE_SCOPE(I2S);
+    TRACE_SCOPE(CPU, "i2s");
     size_t          bytes_written;
     static uint32_t stereo_sample;
-    assert(sizeof(i2s_stereo_out) >= size * 2 * 2);  // 2 channels * 2 bytes per sample
     static int16_t swapped;
 
+    if (samplerate != resampler.getInputRate()) {
+        resampler.init(samplerate, I2S_SAMPLERATE);
+    }
+    assert(sizeof(resampled) / sizeof(resampled[0]) >= resampler.maxOutput(size));
+    size = resampler.process(data, size, resampled);
+    data = resampled;
+    assert(sizeof(i2s_stereo_out) >= size * 2 * 2);  // 2 channels * 2 bytes per sample
+
     for (size_t i = 0; i < size; i++) {
         // Convert the union to use int16_t to match the data type
         // swapped = ((uint16_t(data[i]) << 8) & 0xFF00) | ((uint16_t(data[i]) >> 8) & 0x00FF);
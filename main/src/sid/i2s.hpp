@@ -2,10 +2,16 @@
 #include "driver/i2s_common.h"
 #include "driver/i2s_std.h"
 #include "VIC.hpp"
+#include "resampler.hpp"
+
+// the codec always runs at this rate, the SID output is resampled to it
+#define I2S_SAMPLERATE 48000
 
 class I2S {
     private:
     uint8_t i2s_stereo_out[128 * 2 * 2]; // stereo output buffer
+    int16_t resampled[128];               // mono samples at I2S_SAMPLERATE
+    Resampler resampler;
     i2s_chan_config_t chan_cfg;
     i2s_chan_handle_t i2s_handle;
 
@@ -14,6 +20,7 @@ class I2S {
 
     esp_err_t init();
 
-    esp_err_t write(const int16_t* data, size_t size);
+    // 'samplerate' is the rate the data was rendered at
+    esp_err_t write(const int16_t* data, size_t size, uint32_t samplerate);
 };
 
@@ -0,0 +1,91 @@
+#include "resampler.hpp"
+#include <string.h>
+#include <cmath>
+#include "esp_log.h"
+
+static const char* TAG = "Resampler";
+
+// cutoff relative to the input samplerate, a bit below Nyquist to leave room for the transition band
+#define RESAMPLER_CUTOFF 0.45
+
+void Resampler::init(uint32_t inputRate, uint32_t outputRate)
+{
+    this->inputRate  = inputRate;
+    this->outputRate = outputRate;
+    step             = (inputRate >= outputRate) ? 0 : (uint32_t)(((uint64_t)inputRate << 32) / outputRate);
+    position         = 0;
+    historyPos       = 0;
+    memset(history, 0, sizeof(history));
+
+    // Blackman windowed sinc, one row per sub-sample position. Tap k sits at k - (TAPS / 2 - 1) input samples from
+    // the older of the two samples the output falls between, each row is normalized to unity gain.
+    for (int p = 0; p <= RESAMPLER_PHASES; p++) {
+        double frac = (double)p / RESAMPLER_PHASES;
+        double sum  = 0;
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            double t = k - (RESAMPLER_TAPS / 2 - 1) - frac;
+            double x = 2 * RESAMPLER_CUTOFF * t;
+            double h = (t == 0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double w = 0.42 + 0.5 * cos(2 * M_PI * t / RESAMPLER_TAPS) + 0.08 * cos(4 * M_PI * t / RESAMPLER_TAPS);
+            coeffs[p][k]  = h * w;
+            sum          += h * w;
+        }
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            coeffs[p][k] /= sum;
+        }
+    }
+    ESP_LOGI(TAG, "Resampling %d Hz to %d Hz", (int)inputRate, (int)outputRate);
+}
+
+size_t Resampler::maxOutput(size_t samples) const
+{
+    if (step == 0) {
+        return samples;
+    }
+    return (size_t)(((uint64_t)samples * outputRate + inputRate - 1) / inputRate) + 1;
+}
+
+// Filter the history at the current position, blending the two nearest coefficient rows
+float Resampler::interpolate() const
+{
+    const float* h     = &history[historyPos];
+    uint32_t     phase = position >> (32 - RESAMPLER_PHASE_BITS);
+    float        blend = (position << RESAMPLER_PHASE_BITS) * (1.0f / 4294967296.0f);  // fraction between the rows
+    const float* c0    = coeffs[phase];
+    const float* c1    = coeffs[phase + 1];
+    float        y0 = 0, y1 = 0;
+
+    for (int k = 0; k < RESAMPLER_TAPS; k++) {
+        y0 += c0[k] * h[k];
+        y1 += c1[k] * h[k];
+    }
+    return y0 + (y1 - y0) * blend;
+}
+
+size_t Resampler::process(const int16_t* in, size_t samples, int16_t* out)
+{
+    size_t produced = 0;
+    float  y;
+
+    if (step == 0) {
+        memcpy(out, in, samples * sizeof(int16_t));
+        return samples;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        history[historyPos]                  = in[i];
+        history[historyPos + RESAMPLER_TAPS] = in[i];
+        historyPos                           = (historyPos + 1) % RESAMPLER_TAPS;
+        // every output position up to the next input sample, the position wraps once it passes it
+        do {
+            y = interpolate();
+            if (y >= 32767)
+                out[produced++] = 32767;
+            else if (y <= -32768)
+                out[produced++] = -32768;
+            else
+                out[produced++] = (int16_t)y;
+            position += step;
+        } while (position >= step);
+    }
+    return produced;
+}
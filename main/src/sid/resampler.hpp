@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define RESAMPLER_TAPS       16  // input samples contributing to one output sample
+#define RESAMPLER_PHASE_BITS 6   // 64 sub-sample positions in the coefficient table, interpolated in between
+#define RESAMPLER_PHASES     (1 << RESAMPLER_PHASE_BITS)
+
+// Polyphase windowed-sinc resampler converting the SID output to the I2S samplerate. Only upsampling (or equal
+// rates, which pass through untouched) is supported: the low-pass sits just below the input Nyquist frequency.
+class Resampler {
+   private:
+    float    coeffs[RESAMPLER_PHASES + 1][RESAMPLER_TAPS];
+    float    history[2 * RESAMPLER_TAPS];  // written twice, so the newest RESAMPLER_TAPS samples are contiguous
+    uint8_t  historyPos = 0;
+    uint32_t step       = 0;  // input samples per output sample, 0.32 fixed point
+    uint32_t position   = 0;  // output position between the two middle history samples, 0.32 fixed point
+    uint32_t inputRate  = 0;
+    uint32_t outputRate = 0;
+
+    float interpolate() const;
+
+   public:
+    Resampler() {}
+
+    void init(uint32_t inputRate, uint32_t outputRate);
+
+    uint32_t getInputRate() const { return inputRate; }
+
+    // upper bound of the samples process() produces for the given amount of input samples
+    size_t maxOutput(size_t samples) const;
+
+    // resample 'samples' input samples into 'out', returns the number of samples written
+    size_t process(const int16_t* in, size_t samples, int16_t* out);
+};
@@ -8,6 +8,7 @@
 #include <cmath>
 #include <cstdint>
 #include "Config.hpp"
+#include "Profiler.hpp"
 #include "esp_log.h"
 #include "precalc.hpp"
 // #include "precalc.h"
@@ -16,6 +17,13 @@ typedef uint8_t byte;
 
 const uint8_t FILTSW[9] = {1, 2, 4, 1, 2, 4, 1, 2, 4};
 
+// more than one of triangle, saw and pulse selected
+static inline bool isCombinedWF(uint8_t ctrl)
+{
+    uint8_t wf = ctrl & (TRI_BITMASK | SAW_BITMASK | PULSE_BITMASK);
+    return wf & (wf - 1);
+}
+
 // sample output buffer
 int16_t  sample_buffer[SAMPLE_BUFFER_SIZE];
 uint16_t sample_buffer_pos = 0;
@@ -27,14 +35,7 @@ SID::SID()
 void SID::cSID_init()
 {
     int i;
-    clock_ratio = C64_PAL_CPUCLK / DEFAULT_SAMPLERATE;
-    if (CLOCK_RATIO > 9) {
-        ADSRperiods[0] = CLOCK_RATIO;
-        ADSRstep[0]    = ceil(CLOCK_RATIO / 9.0);
-    } else {
-        ADSRperiods[0] = 9.0;
-        ADSRstep[0]    = 1;
-    }
+    setSampleRate(samplerate);
 
     // const static cutoff_ratio_8580 = -2 * 3.14 * (12500.0 / 2048) /
     //                     samplerate;  // -2 * 3.14 * ((82000/6.8) / 2048) / samplerate; //approx. 30Hz..12kHz
@@ -79,6 +80,23 @@ void SID::cSID_init()
     }
 }
 
+// Derive everything that depends on the samplerate. Rendering must not run at the same time.
+void SID::setSampleRate(uint32_t rate)
+{
+    samplerate        = rate;
+    clock_ratio       = C64_PAL_CPUCLK / samplerate;
+    accu_ratio        = lround(clock_ratio * 256);
+    cutoff_ratio_8580 = CUTOFF_RATIO_8580_HZ / samplerate;
+    samples_per_line  = 63 / clock_ratio;
+    if (clock_ratio > 9) {
+        ADSRperiods[0] = clock_ratio;
+        ADSRstep[0]    = ceil(clock_ratio / 9.0);
+    } else {
+        ADSRperiods[0] = 9.0;
+        ADSRstep[0]    = 1;
+    }
+}
+
 // registers: 0:freql1  1:freqh1  2:pwml1  3:pwmh1  4:ctrl1  5:ad1   6:sr1
 // 7:freql2  8:freqh2  9:pwml2 10:pwmh2 11:ctrl2 12:ad2  13:sr 14:freql3
 // 15:freqh3 16:pwml3 17:pwmh3 18:ctrl3 19:ad3  20:sr3
@@ -111,25 +129,176 @@ void SID::init(uint8_t* memory, AudioCallback audio_callback, int SID_model)
         ADSRstate[i] = HOLDZERO_BITMASK;
         ratecnt[i] = envcnt[i] = expcnt[i] = 0;
     }
+    memset(pending_regs, 0, sizeof(pending_regs));
+    pending_samples   = 0;
+    scan_line_sync    = 0.0;
+    sample_buffer_pos = 0;
 }
 
 // Run the SID cycles the correct amount te keep in sync with the scan lines
 void SID::raster_line()
 {
-    scan_line_sync += (float)SAMPLES_PER_SCAN_LINE;
+    PROFILE_SCOPE(SID);
+    uint16_t samples = 0;
+
+    if (requested_samplerate.load(std::memory_order_relaxed) != 0) {
+        // finish and send out everything rendered at the old rate first
+        drain();
+        setSampleRate(requested_samplerate.exchange(0));
+        ESP_LOGI("SID", "Samplerate set to %d Hz", (int)samplerate);
+    }
+
+    scan_line_sync += samples_per_line;
     // scan_line_sync    += nr_samples;
     while (scan_line_sync > 1.0) {
-        // baseaddr 0x0000 because the memory presented to the SID is SID the IO area only.
-        sample_buffer[sample_buffer_pos++] = cycle(0, 0x0000);
+        samples++;
+        scan_line_sync -= 1.0;
+    }
+
+    // Lines are collected while the registers stay the same and rendered as one block. The output only depends on the
+    // register values, so this gives the same samples as rendering line by line, just up to a block later.
+    // baseaddr 0x0000 because the memory presented to the SID is SID the IO area only.
+    if (memcmp(pending_regs, &memory[0x0000], SID_REG_AMOUNT) != 0) {
+        flush();
+        memcpy(pending_regs, &memory[0x0000], SID_REG_AMOUNT);
+    }
+    pending_samples += samples;
+    if (pending_samples >= SID_BLOCK_SIZE) {
+        flush();
+    }
+}
+
+void SID::drain()
+{
+    flush();
+    if (sample_buffer_pos != 0) {
+        audio_callback(sample_buffer, sample_buffer_pos);
+        sample_buffer_pos = 0;
+    }
+}
+
+// Render the samples collected by raster_line() with the register values they were collected with
+void SID::flush()
+{
+    uint16_t n;
+
+    if (pending_samples == 0) {
+        return;
+    }
+    if (isSilent(0, pending_regs)) {
+        // Nothing audible: only keep the oscillators running and send out silence
+        skipSilent(0, pending_regs, pending_samples);
+        emitSamples(0, pending_samples);
+        pending_samples = 0;
+        return;
+    }
+    // render straight into the output buffer, in pieces that fit up to the next flush
+    while (pending_samples) {
+        n = SAMPLE_BUFFER_SIZE - sample_buffer_pos;
+        if (n > pending_samples) n = pending_samples;
+        render(0, pending_regs, &sample_buffer[sample_buffer_pos], n);
+        sample_buffer_pos += n;
+        pending_samples   -= n;
+        if (sample_buffer_pos == SAMPLE_BUFFER_SIZE) {
+            audio_callback(sample_buffer, sample_buffer_pos);
+            sample_buffer_pos = 0;
+        }
+    }
+    updateReadableRegs(0, 0x0000);
+}
 
-        // When the buffer is full, send the samples to the audio callback
+// Append samples with the same value to the output buffer, when the buffer is full, send the samples to the audio
+// callback
+void SID::emitSamples(int16_t value, uint16_t samples)
+{
+    while (samples--) {
+        sample_buffer[sample_buffer_pos++] = value;
         if (sample_buffer_pos == SAMPLE_BUFFER_SIZE) {
             audio_callback(sample_buffer, sample_buffer_pos);
             sample_buffer_pos = 0;
         }
+    }
+}
 
-        scan_line_sync -= 1.0;
+// A SID is silent when every voice has released to zero and cannot be re-triggered by a gate edge, and the filter
+// integrators have settled. In that state cycle() returns exactly 0, whatever the waveform, filter and volume
+// registers contain. Test and sync bits reset the accumulators and combined waveforms carry smoothing state, voices
+// using them take the normal path.
+bool SID::isSilent(unsigned char num, const byte* sReg)
+{
+    const byte* vReg = sReg;
+
+    if (prevlowpass[num] != 0 || prevbandpass[num] != 0) {
+        return false;
     }
+    for (uint8_t channel = num * SID_CHANNEL_AMOUNT; channel < (num + 1) * SID_CHANNEL_AMOUNT;
+         channel++, vReg += 7) {
+        if (envcnt[channel] != 0 || !(ADSRstate[channel] & HOLDZERO_BITMASK) ||
+            (vReg[4] & (GATE_BITMASK | SYNC_BITMASK | TEST_BITMASK)) || (ADSRstate[channel] & GATE_BITMASK) ||
+            isCombinedWF(vReg[4])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Advance a silent SID by a number of samples without generating waveforms. Phase accumulators are advanced in one
+// step, the noise LFSR is clocked as often as the per-sample code would have seen accumulator bit 20 toggle.
+void SID::skipSilent(unsigned char num, const byte* sReg, uint16_t samples)
+{
+    const byte* vReg = sReg;
+    uint32_t    accuadd, last, MSB = 0;
+    uint64_t    total;
+
+    if (samples == 0) {
+        return;
+    }
+    for (uint8_t channel = num * SID_CHANNEL_AMOUNT; channel < (num + 1) * SID_CHANNEL_AMOUNT;
+         channel++, vReg += 7) {
+        // released envelope: only the rate and exponential counters keep running
+        for (uint16_t i = 0; i < samples; i++) {
+            clockSilentEnvelope(channel, vReg[6]);
+        }
+        prevSR[channel] = vReg[6];
+
+        accuadd = ((vReg[0] + vReg[1] * 256) * accu_ratio) >> 8;
+        total   = (uint64_t)phaseaccu[channel] + (uint64_t)accuadd * samples;
+        last    = (total - accuadd) & 0xFFFFFF;
+        if (vReg[4] & NOISE_BITMASK) {
+            // an accumulator step below 0x100000 can toggle bit 20 at most once per sample
+            clockNoise(channel,
+                       accuadd >= 0x100000 ? samples : (uint32_t)((total >> 20) - (phaseaccu[channel] >> 20)));
+        }
+        phaseaccu[channel] = total & 0xFFFFFF;
+        prevaccu[channel]  = phaseaccu[channel];
+        MSB                = phaseaccu[channel] & 0x800000;
+        sourceMSBrise[num] = (MSB > (last & 0x800000)) ? 1 : 0;
+    }
+    sourceMSB[num] = MSB;
+}
+
+// Rate counter handling of cycle() for a voice in release with the envelope held at zero
+void SID::clockSilentEnvelope(uint8_t channel, uint8_t SR)
+{
+    float period = ADSRperiods[SR & 0x0F];
+
+    ratecnt[channel] += clock_ratio;
+    if (ratecnt[channel] >= 0x8000) ratecnt[channel] -= 0x8000;
+    if (ratecnt[channel] >= period && ratecnt[channel] < period + clock_ratio) {
+        ratecnt[channel] -= period;
+        if (++expcnt[channel] == ADSR_exptable[envcnt[channel]]) {
+            expcnt[channel] = 0;
+        }
+    }
+}
+
+void SID::clockNoise(uint8_t channel, uint32_t clocks)
+{
+    uint32_t lfsr = noise_LFSR[channel];
+    while (clocks--) {
+        lfsr = ((lfsr << 1) + (((lfsr & 0x400000) ^ ((lfsr & 0x20000) << 5)) ? 1 : 0)) & 0x7FFFFF;
+    }
+    noise_LFSR[channel] = lfsr;
 }
 
 // Based on Schraudolph's "A Fast, Compact Approximation of the Exponential Function"
@@ -145,285 +314,387 @@ float fast_exp(float x)
 // My SID implementation is similar to what I worked out in a SwinSID variant during 3..4 months of development. (So
 // jsSID only took 2 weeks armed with this experience.) I learned the workings of ADSR/WAVE/filter operations mainly
 // from the quite well documented resid and resid-fp codes. (The SID reverse-engineering sites were also good sources.)
-// Note that I avoided many internal/automatic variables from the SID function, assuming better speed this way. (Not
-// using stack as much, but I'm not sure and it may depend on platform...) (The same is true for CPU emulation and
-// player-code.)
-// My SID implementation is similar to what I worked out in a SwinSID variant during 3..4 months of development. (So
-// jsSID only took 2 weeks armed with this experience.) I learned the workings of ADSR/WAVE/filter operations mainly
-// from the quite well documented resid and resid-fp codes. (The SID reverse-engineering sites were also good sources.)
-// Note that I avoided many internal/automatic variables from the SID function, assuming better speed this way. (Not
-// using stack as much, but I'm not sure and it may depend on platform...) (The same is true for CPU emulation and
-// player-code.)
+//
+// Samples are rendered in blocks: register-derived parameters are decoded once per block, each voice then runs its
+// envelope, accumulator and waveform loops over the whole block, and the mixed voice outputs go through the filter in
+// a last pass. Sync and ring modulation couple the voices sample by sample, so while any voice uses them the voices
+// are interleaved one sample at a time.
+void SID::render(unsigned char num, const byte* sReg, int16_t* out, uint16_t samples)
+{
+    const byte* vReg;
+    uint8_t     channel, first = num * SID_CHANNEL_AMOUNT, last = first + SID_CHANNEL_AMOUNT;
+    uint16_t    n, i;
+    bool        coupled = false;
+
+    for (channel = first, vReg = sReg; channel < last; channel++, vReg += 7) {
+        if (vReg[4] & (SYNC_BITMASK | RING_BITMASK)) coupled = true;
+    }
+    while (samples) {
+        n = (samples < SID_BLOCK_SIZE) ? samples : SID_BLOCK_SIZE;
+        memset(block_filtin, 0, n * sizeof(block_filtin[0]));
+        memset(block_nonfilt, 0, n * sizeof(block_nonfilt[0]));
+        if (coupled) {
+            for (i = 0; i < n; i++) {
+                for (channel = first, vReg = sReg; channel < last; channel++, vReg += 7) {
+                    renderVoice(num, channel, vReg, sReg, i, 1);
+                }
+            }
+        } else {
+            for (channel = first, vReg = sReg; channel < last; channel++, vReg += 7) {
+                renderVoice(num, channel, vReg, sReg, 0, n);
+            }
+        }
+        renderFilter(num, sReg, out, n);
+        out     += n;
+        samples -= n;
+    }
+}
+
+// update readable SID1-registers (some SID tunes might use 3rd channel ENV3/OSC3 value as control)
+void SID::updateReadableRegs(unsigned char num, uint32_t baseaddr)
+{
+    if (num == 0 && memory[1] & 3) {
+        memory[baseaddr + 0x1B] = prevwfout[SID_CHANNEL_AMOUNT - 1] >> 8;
+        memory[baseaddr + 0x1C] = envcnt[3];
+    }  // OSC3, ENV3 (some players rely on it)
+}
+
+// Single sample, kept for callers that step the SID themselves
 int SID::cycle(unsigned char num,
                uint32_t      baseaddr)  // the SID emulation itself ('num' is the number of SID to iterate (0..2)
 {
-    // better keep these variables static so they won't slow down the routine like if they were internal automatic
-    // variables always recreated
-    static byte     channel, ctrl, SR, prevgate, wf, test, *sReg, *vReg;
-    static uint32_t accuadd, MSB, pw, wfout;
-    static int32_t  step, lim, nonfilt, filtin, filtout, output;
-    static int32_t  tmp;
-    static float    period, steep, rDS_VCR_FET, cutoff[3], resonance[3], ftmp;
-
-    filtin = nonfilt = 0;
-    sReg             = &memory[baseaddr];
-    vReg             = sReg;
-
-    // treating 2SID and 3SID channels uniformly (0..5 / 0..8), this probably avoids some extra code
-    for (channel = num * SID_CHANNEL_AMOUNT; channel < (num + 1) * SID_CHANNEL_AMOUNT; channel++, vReg += 7) {
-        ctrl = vReg[4];  // SID channel control register ([7]NSE, [6]PUL, [5]SAW, [4]TRI, [3] test, [2] ring voice 3,
-                         // [1] sync voice 3, [0] gate)
-
-        // ADSR envelope-generator:
-        SR       = vReg[6];  // Sustain / release register ([7:4] Sustain, [3:0] Release)
-        tmp      = 0;
-        prevgate = (ADSRstate[channel] & GATE_BITMASK);
-        if (prevgate != (ctrl & GATE_BITMASK)) {  // gatebit-change?
-            if (prevgate)
-                ADSRstate[channel] &= ~(GATE_BITMASK | ATTACK_BITMASK | DECAYSUSTAIN_BITMASK);
-            else {  // falling edge
-                ADSRstate[channel] =
-                    (GATE_BITMASK | ATTACK_BITMASK | DECAYSUSTAIN_BITMASK);  // rising edge, also sets hold_zero_bit=0
-                if ((SR & 0x0F) > (prevSR[channel] & 0x0F))
-                    tmp =
-                        1;  // assume SR->GATE write order: workaround to have crisp soundstarts by triggering delay-bug
-            }  //(this is for the possible missed CTRL(GATE) vs SR register write order situations (1MHz CPU is cca 20
-               // times faster than samplerate)
+    int16_t sample;
+    render(num, &memory[baseaddr], &sample, 1);
+    updateReadableRegs(num, baseaddr);
+    return sample;
+}
+
+// Render one voice for 'samples' samples starting at block position 'pos' and add it to the filter or the unfiltered
+// mix. The registers don't change during a block, so everything derived from them is decoded up front.
+void SID::renderVoice(uint8_t num, uint8_t channel, const byte* vReg, const byte* sReg, uint16_t pos,
+                      uint16_t samples)
+{
+    // SID channel control register ([7]NSE, [6]PUL, [5]SAW, [4]TRI, [3] test, [2] ring voice 3, [1] sync voice 3,
+    // [0] gate)
+    const byte     ctrl     = vReg[4];
+    const byte     SR       = vReg[6];  // Sustain / release register ([7:4] Sustain, [3:0] Release)
+    const byte     wf       = ctrl & 0xF0;
+    const byte     test     = ctrl & TEST_BITMASK;
+    const bool     combined = isCombinedWF(ctrl);
+    const uint32_t accuadd  = ((vReg[0] + vReg[1] * 256) * accu_ratio) >> 8;
+    const uint32_t ringMSB  = (ctrl & RING_BITMASK) ? sourceMSB[num] : 0;
+    const bool     reset    = test || ((ctrl & SYNC_BITMASK) && sourceMSBrise[num]);
+    int16_t*       env      = &block_env[pos];
+    uint32_t*      phase    = &block_phase[pos];
+    uint32_t*      wave     = &block_wave[pos];
+    int32_t*       mix      = nullptr;
+    int            audible  = -1;  // last sample of the block where the voice is not held at zero
+    uint16_t       i;
+
+    // routing the channel signal to either the filter or the unfiltered master output depending on filter-switch
+    // SID-registers
+    if (sReg[0x17] & FILTSW[channel])
+        mix = &block_filtin[pos];
+    else if ((FILTSW[channel] != 4) || !(sReg[0x18] & OFF3_BITMASK))
+        mix = &block_nonfilt[pos];
+
+    // ADSR envelope-generator:
+    {
+        byte    state   = ADSRstate[channel];
+        byte    exp     = expcnt[channel];
+        int16_t cnt     = envcnt[channel];
+        float   rate    = ratecnt[channel];
+        bool    delayed = false;
+        int32_t step;
+        float   period;
+
+        if ((state & GATE_BITMASK) != (ctrl & GATE_BITMASK)) {  // gatebit-change?
+            if (state & GATE_BITMASK)
+                state &= ~(GATE_BITMASK | ATTACK_BITMASK | DECAYSUSTAIN_BITMASK);  // falling edge
+            else {  // rising edge, also sets hold_zero_bit=0
+                state = (GATE_BITMASK | ATTACK_BITMASK | DECAYSUSTAIN_BITMASK);
+                // assume SR->GATE write order: workaround to have crisp soundstarts by triggering delay-bug (this is
+                // for the possible missed CTRL(GATE) vs SR register write order situations (1MHz CPU is cca 20 times
+                // faster than samplerate)
+                if ((SR & 0x0F) > (prevSR[channel] & 0x0F)) delayed = true;
+            }
         }
-        prevSR[channel]   = SR;  // if(SR&0xF) ratecnt[channel]+=5;  //assume SR->GATE write order: workaround to have
-                                 // crisp soundstarts by triggering delay-bug
-        ratecnt[channel] += CLOCK_RATIO;
-        if (ratecnt[channel] >= 0x8000)
-            ratecnt[channel] -= 0x8000;  // can wrap around (ADSR delay-bug: short 1st
-                                         // frame)
-        // set ADSR period that should be checked against rate-counter (depending on ADSR state
-        // Attack/DecaySustain/Release)
-        if (ADSRstate[channel] & ATTACK_BITMASK)
-            step = vReg[5] >> 4;
-        else if (ADSRstate[channel] & DECAYSUSTAIN_BITMASK)
-            step = vReg[5] & 0x0F;
-        else  // Step is release
-            step = SR & 0x0F;
-        period = ADSRperiods[step];
-        step   = ADSRstep[step];
-        if (ratecnt[channel] >= period && ratecnt[channel] < period + CLOCK_RATIO &&
-            tmp == 0) {                  // ratecounter shot (matches rateperiod) (in genuine SID ratecounter is LFSR)
-            ratecnt[channel] -= period;  // compensation for timing instead of simply setting 0 on rate-counter overload
-            if ((ADSRstate[channel] & ATTACK_BITMASK) || ++expcnt[channel] == ADSR_exptable[envcnt[channel]]) {
-                if (!(ADSRstate[channel] & HOLDZERO_BITMASK)) {
-                    if (ADSRstate[channel] & ATTACK_BITMASK) {
-                        envcnt[channel] += step;
-                        if (envcnt[channel] >= 0xFF) {
-                            envcnt[channel]     = 0xFF;
-                            ADSRstate[channel] &= 0xFF - ATTACK_BITMASK;
-                        }
-                    } else if (!(ADSRstate[channel] & DECAYSUSTAIN_BITMASK) ||
-                               envcnt[channel] > (SR & 0xF0) + (SR >> 4)) {
-                        envcnt[channel] -= step;
-                        if (envcnt[channel] <= 0 && envcnt[channel] + step != 0) {
-                            envcnt[channel]     = 0;
-                            ADSRstate[channel] |= HOLDZERO_BITMASK;
+        prevSR[channel] = SR;
+
+        const float   attackPeriod  = ADSRperiods[vReg[5] >> 4];
+        const float   decayPeriod   = ADSRperiods[vReg[5] & 0x0F];
+        const float   releasePeriod = ADSRperiods[SR & 0x0F];
+        const int32_t attackStep    = ADSRstep[vReg[5] >> 4];
+        const int32_t decayStep     = ADSRstep[vReg[5] & 0x0F];
+        const int32_t releaseStep   = ADSRstep[SR & 0x0F];
+        const int16_t sustain       = (SR & 0xF0) + (SR >> 4);
+
+        for (i = 0; i < samples; i++) {
+            rate += clock_ratio;
+            if (rate >= 0x8000) rate -= 0x8000;  // can wrap around (ADSR delay-bug: short 1st frame)
+            // set ADSR period that should be checked against rate-counter (depending on ADSR state
+            // Attack/DecaySustain/Release)
+            if (state & ATTACK_BITMASK) {
+                period = attackPeriod;
+                step   = attackStep;
+            } else if (state & DECAYSUSTAIN_BITMASK) {
+                period = decayPeriod;
+                step   = decayStep;
+            } else {
+                period = releasePeriod;
+                step   = releaseStep;
+            }
+            // ratecounter shot (matches rateperiod) (in genuine SID ratecounter is LFSR)
+            if (rate >= period && rate < period + clock_ratio && !delayed) {
+                rate -= period;  // compensation for timing instead of simply setting 0 on rate-counter overload
+                if ((state & ATTACK_BITMASK) || ++exp == ADSR_exptable[cnt]) {
+                    if (!(state & HOLDZERO_BITMASK)) {
+                        if (state & ATTACK_BITMASK) {
+                            cnt += step;
+                            if (cnt >= 0xFF) {
+                                cnt    = 0xFF;
+                                state &= 0xFF - ATTACK_BITMASK;
+                            }
+                        } else if (!(state & DECAYSUSTAIN_BITMASK) || cnt > sustain) {
+                            cnt -= step;
+                            if (cnt <= 0 && cnt + step != 0) {
+                                cnt    = 0;
+                                state |= HOLDZERO_BITMASK;
+                            }
                         }
                     }
+                    exp = 0;
                 }
-                expcnt[channel] = 0;
             }
+            delayed  = false;
+            cnt     &= 0xFF;
+            env[i]   = cnt;
+            // a voice held at zero adds nothing to the mix, its waveform only matters for the DAC and the LFSR
+            if (cnt != 0 || !(state & HOLDZERO_BITMASK) || combined) audible = i;
         }
-        envcnt[channel] &= 0xFF;
-
-        // WAVE-generation code (phase accumulator and waveform-selector):
-        test    = ctrl & TEST_BITMASK;
-        wf      = ctrl & 0xF0;
-        accuadd = (vReg[0] + vReg[1] * 256) * (uint32_t)CLOCK_RATIO;
-        if (test || ((ctrl & SYNC_BITMASK) && sourceMSBrise[num]))
-            phaseaccu[channel] = 0;
-        else {
-            phaseaccu[channel] += accuadd;
-            if (phaseaccu[channel] > 0xFFFFFF) phaseaccu[channel] -= 0x1000000;
+        ADSRstate[channel] = state;
+        expcnt[channel]    = exp;
+        envcnt[channel]    = cnt;
+        ratecnt[channel]   = rate;
+    }
+
+    // WAVE-generation code (phase accumulator and waveform-selector):
+    uint32_t accu = phaseaccu[channel], prev = prevaccu[channel];
+    if (reset) {
+        for (i = 0; i < samples; i++) phase[i] = 0;
+        accu = 0;
+    } else {
+        for (i = 0; i < samples; i++) {
+            accu     = (accu + accuadd) & 0xFFFFFF;
+            phase[i] = accu;
         }
-        phaseaccu[channel] &= 0xFFFFFF;
-        MSB                 = phaseaccu[channel] & 0x800000;
-        sourceMSBrise[num]  = (MSB > (prevaccu[channel] & 0x800000)) ? 1 : 0;
-        if (wf & NOISE_BITMASK) {  // noise waveform
-            tmp = noise_LFSR[channel];
-            if (((phaseaccu[channel] & 0x100000) != (prevaccu[channel] & 0x100000)) ||
-                accuadd >= 0x100000)  // clock LFSR all time if clockrate exceeds observable at given samplerate
-            {
-                step                = (tmp & 0x400000) ^ ((tmp & 0x20000) << 5);
-                tmp                 = ((tmp << 1) + (step ? 1 : test)) & 0x7FFFFF;
-                noise_LFSR[channel] = tmp;
+    }
+    sourceMSBrise[num] = ((accu & 0x800000) > ((samples > 1 ? phase[samples - 2] : prev) & 0x800000)) ? 1 : 0;
+
+    if (wf & NOISE_BITMASK) {  // noise waveform
+        uint32_t lfsr = noise_LFSR[channel];
+        int32_t  step;
+        for (i = 0; i < samples; i++) {
+            // clock LFSR all time if clockrate exceeds observable at given samplerate
+            if (((phase[i] ^ prev) & 0x100000) || accuadd >= 0x100000) {
+                step = (lfsr & 0x400000) ^ ((lfsr & 0x20000) << 5);
+                lfsr = ((lfsr << 1) + (step ? 1 : test)) & 0x7FFFFF;
             }
-            // we simply zero output when other waveform is mixed with noise. On real SID LFSR continuously gets filled
-            // by zero and locks up. ($C1 waveform with pw<8 can keep it for a while...)
-            wfout = (wf & 0x70) ? 0
-                                : ((tmp & 0x100000) >> 5) + ((tmp & 0x40000) >> 4) + ((tmp & 0x4000) >> 1) +
-                                      ((tmp & 0x800) << 1) + ((tmp & 0x200) << 2) + ((tmp & 0x20) << 5) +
-                                      ((tmp & 0x04) << 7) + ((tmp & 0x01) << 8);
-        } else if (wf & PULSE_BITMASK) {  // simple pulse
-            pw  = (vReg[2] + (vReg[3] & 0x0F) * 256) * 16;
-            tmp = (int)accuadd >> 9;
-            if (0 < pw && pw < tmp) pw = tmp;
-            tmp ^= 0xFFFF;
-            if (pw > tmp) pw = tmp;
-            tmp = phaseaccu[channel] >> 8;
-            if (wf == PULSE_BITMASK) {  // simple pulse, most often used waveform, make it sound as clean as possible
-                                        // without oversampling
-                // One of my biggest success with the SwinSID-variant was that I could clean the high-pitched and thin
-                // sounds. (You might have faced with the unpleasant sound quality of high-pitched sounds without
-                // oversampling. We need so-called 'band-limited' synthesis instead.
-                //  There are a lot of articles about this issue on the internet. In a nutshell, the harsh edges produce
-                //  harmonics that exceed the Nyquist frequency (samplerate/2) and they are folded back into hearable
-                //  range, producing unvanted ringmodulation-like effect.)
-                // After so many trials with dithering/filtering/oversampling/etc. it turned out I can't eliminate the
-                // fukkin aliasing in time-domain, as suggested at pages. Oversampling (running the wave-generation 8
-                // times more) was not a way at 32MHz SwinSID. It might be an option on PC but I don't prefer it in
-                // JavaScript.) The only solution that worked for me in the end, what I came up with eventually: The
-                // harsh rising and falling edges of the pulse are elongated making it a bit trapezoid. But not in
-                // time-domain, but altering the transfer-characteristics. This had to be done in a frequency-dependent
-                // way, proportionally to pitch, to keep the deep sounds crisp. The following code does this (my
-                // favourite testcase is Robocop3 intro):
-                step = (accuadd >= 255) ? 65535 / (accuadd / 256.0)
-                                        : 0xFFFF;  // simple pulse, most often used waveform, make it sound as clean as
-                                                   // possible without oversampling
+            prev = phase[i];
+            // we simply zero output when other waveform is mixed with noise. On real SID LFSR continuously gets
+            // filled by zero and locks up. ($C1 waveform with pw<8 can keep it for a while...)
+            wave[i] = (wf & 0x70) ? 0
+                                  : ((lfsr & 0x100000) >> 5) + ((lfsr & 0x40000) >> 4) + ((lfsr & 0x4000) >> 1) +
+                                        ((lfsr & 0x800) << 1) + ((lfsr & 0x200) << 2) + ((lfsr & 0x20) << 5) +
+                                        ((lfsr & 0x04) << 7) + ((lfsr & 0x01) << 8);
+        }
+        noise_LFSR[channel] = lfsr;
+    } else if (audible < 0) {
+        // held at zero for the whole block, the waveform is not needed
+    } else if (wf & PULSE_BITMASK) {  // simple pulse
+        uint32_t pw = (vReg[2] + (vReg[3] & 0x0F) * 256) * 16;
+        int32_t  tmp = (int)accuadd >> 9, step, lim;
+        if (0 < pw && pw < tmp) pw = tmp;
+        tmp ^= 0xFFFF;
+        if (pw > tmp) pw = tmp;
+        if (wf == PULSE_BITMASK) {  // simple pulse, most often used waveform, make it sound as clean as possible
+                                    // without oversampling
+            // One of my biggest success with the SwinSID-variant was that I could clean the high-pitched and thin
+            // sounds. (You might have faced with the unpleasant sound quality of high-pitched sounds without
+            // oversampling. We need so-called 'band-limited' synthesis instead.
+            //  There are a lot of articles about this issue on the internet. In a nutshell, the harsh edges produce
+            //  harmonics that exceed the Nyquist frequency (samplerate/2) and they are folded back into hearable
+            //  range, producing unvanted ringmodulation-like effect.)
+            // After so many trials with dithering/filtering/oversampling/etc. it turned out I can't eliminate the
+            // fukkin aliasing in time-domain, as suggested at pages. Oversampling (running the wave-generation 8
+            // times more) was not a way at 32MHz SwinSID. It might be an option on PC but I don't prefer it in
+            // JavaScript.) The only solution that worked for me in the end, what I came up with eventually: The
+            // harsh rising and falling edges of the pulse are elongated making it a bit trapezoid. But not in
+            // time-domain, but altering the transfer-characteristics. This had to be done in a frequency-dependent
+            // way, proportionally to pitch, to keep the deep sounds crisp. The following code does this (my
+            // favourite testcase is Robocop3 intro):
+            step = (accuadd >= 255) ? 65535 / (accuadd / 256.0) : 0xFFFF;
+            for (i = 0; i < samples; i++) {
+                tmp = phase[i] >> 8;
                 if (test)
-                    wfout = 0xFFFF;
+                    wave[i] = 0xFFFF;
                 else if (tmp < pw) {
                     lim = (0xFFFF - pw) * step;
                     if (lim > 0xFFFF) lim = 0xFFFF;
-                    tmp   = lim - (pw - tmp) * step;
-                    wfout = (tmp < 0) ? 0 : tmp;
+                    tmp     = lim - (pw - tmp) * step;
+                    wave[i] = (tmp < 0) ? 0 : tmp;
                 }  // rising edge
                 else {
                     lim = pw * step;
                     if (lim > 0xFFFF) lim = 0xFFFF;
-                    tmp   = (0xFFFF - tmp) * step - lim;
-                    wfout = (tmp >= 0) ? 0xFFFF : tmp;
+                    tmp     = (0xFFFF - tmp) * step - lim;
+                    wave[i] = (tmp >= 0) ? 0xFFFF : tmp;
                 }  // falling edge
-            } else {  // combined pulse
-                wfout = (tmp >= pw || test)
-                            ? 0xFFFF
-                            : 0;  //(this would be enough for a simple but aliased-at-high-pitches pulse)
+            }
+        } else {  // combined pulse
+            for (i = 0; i < samples; i++) {
+                tmp     = phase[i] >> 8;
+                wave[i] = (tmp >= pw || test) ? 0xFFFF : 0;  //(this would be enough for a simple but
+                                                               // aliased-at-high-pitches pulse)
                 if (wf & TRI_BITMASK) {
                     if (wf & SAW_BITMASK) {
-                        wfout = wfout ? combinedWF(num, channel, PulseTriSaw_8580, tmp >> 4, 1, vReg[1]) : 0;
+                        wave[i] = wave[i] ? combinedWF(num, channel, PulseTriSaw_8580, tmp >> 4, 1, vReg[1]) : 0;
                     }  // pulse+saw+triangle (waveform nearly identical to tri+saw)
                     else {
-                        tmp   = phaseaccu[channel] ^ (ctrl & RING_BITMASK ? sourceMSB[num] : 0);
-                        wfout = (wfout) ? combinedWF(num, channel, PulseSaw_8580,
-                                                     (tmp ^ (tmp & 0x800000 ? 0xFFFFFF : 0)) >> 11, 0, vReg[1])
-                                        : 0;
+                        tmp     = phase[i] ^ ringMSB;
+                        wave[i] = wave[i] ? combinedWF(num, channel, PulseSaw_8580,
+                                                       (tmp ^ (tmp & 0x800000 ? 0xFFFFFF : 0)) >> 11, 0, vReg[1])
+                                          : 0;
                     }
                 }  // pulse+triangle
                 else if (wf & SAW_BITMASK)
-                    wfout = wfout ? combinedWF(num, channel, PulseSaw_8580, tmp >> 4, 1, vReg[1]) : 0;  // pulse+saw
+                    wave[i] = wave[i] ? combinedWF(num, channel, PulseSaw_8580, tmp >> 4, 1, vReg[1]) : 0;  // pulse+saw
             }
-        } else if (wf & SAW_BITMASK) {        // saw
-            wfout = phaseaccu[channel] >> 8;  // saw (this row would be enough for simple but aliased-at-high-pitch saw)
-            // The anti-aliasing (cleaning) of high-pitched sawtooth wave works by the same principle as mentioned above
-            // for the pulse, but the sawtooth has even harsher edge/transition, and as the falling edge gets longer,
-            // tha rising edge should became shorter, and to keep the amplitude, it should be multiplied a little bit
-            // (with reciprocal of rising-edge steepness). The waveform at the output essentially becomes an asymmetric
-            // triangle, more-and-more approaching symmetric shape towards high frequencies. (If you check a recording
-            // from the real SID, you can see a similar shape, the high-pitch sawtooth waves are triangle-like...) But
-            // for deep sounds the sawtooth is really close to a sawtooth, as there is no aliasing there, but deep
-            // sounds should be sharp...
-            if (wf & TRI_BITMASK)
-                wfout = combinedWF(num, channel, TriSaw_8580, wfout >> 4, 1, vReg[1]);  // saw+triangle
-            else {  // simple cleaned (bandlimited) saw
-                steep = (accuadd / 65536.0) / 288.0;
-                if (steep == 0) steep = 1;  // avoid division by zero
+        }
+    } else if (wf & SAW_BITMASK) {  // saw
+        // The anti-aliasing (cleaning) of high-pitched sawtooth wave works by the same principle as mentioned above
+        // for the pulse, but the sawtooth has even harsher edge/transition, and as the falling edge gets longer,
+        // tha rising edge should became shorter, and to keep the amplitude, it should be multiplied a little bit
+        // (with reciprocal of rising-edge steepness). The waveform at the output essentially becomes an asymmetric
+        // triangle, more-and-more approaching symmetric shape towards high frequencies. (If you check a recording
+        // from the real SID, you can see a similar shape, the high-pitch sawtooth waves are triangle-like...) But
+        // for deep sounds the sawtooth is really close to a sawtooth, as there is no aliasing there, but deep
+        // sounds should be sharp...
+        if (wf & TRI_BITMASK) {
+            for (i = 0; i < samples; i++) {
+                wave[i] = combinedWF(num, channel, TriSaw_8580, phase[i] >> 12, 1, vReg[1]);  // saw+triangle
+            }
+        } else {  // simple cleaned (bandlimited) saw
+            float    steep = (accuadd / 65536.0) / 288.0;
+            uint32_t wfout;
+            if (steep == 0) steep = 1;  // avoid division by zero
+            for (i = 0; i < samples; i++) {
+                wfout  = phase[i] >> 8;  // saw (this row would be enough for simple but aliased-at-high-pitch saw)
                 wfout += wfout * steep;
                 if (wfout > 0xFFFF) wfout = 0xFFFF - (wfout - 0x10000) / steep;
+                wave[i] = wfout;
             }
-        } else if (wf & TRI_BITMASK) {  // triangle (this waveform has no harsh edges, so it doesn't suffer from strong
-                                        // aliasing at high pitches)
-            tmp   = phaseaccu[channel] ^ (ctrl & RING_BITMASK ? sourceMSB[num] : 0);
-            wfout = (tmp ^ (tmp & 0x800000 ? 0xFFFFFF : 0)) >> 7;
         }
-        wfout &= 0xFFFF;
-        if (wf)
-            prevwfout[channel] = wfout;
-        else {
-            wfout = prevwfout[channel];
-        }  // emulate waveform 00 floating wave-DAC (on real SID waveform00 decays after 15s..50s depending on
-           // temperature?)
-        prevaccu[channel] = phaseaccu[channel];
-        sourceMSB[num]    = MSB;  //(So the decay is not an exact value. Anyway, we just simply keep the value to avoid
-                                  // clicks and support SounDemon digi later...)
-
-        // routing the channel signal to either the filter or the unfiltered master output depending on filter-switch
-        // SID-registers
-        if (sReg[0x17] & FILTSW[channel])
-            filtin += ((int)wfout - 0x8000) * envcnt[channel] / 256;
-        else if ((FILTSW[channel] != 4) || !(sReg[0x18] & OFF3_BITMASK))
-            nonfilt += ((int)wfout - 0x8000) * envcnt[channel] / 256;
+    } else if (wf & TRI_BITMASK) {  // triangle (this waveform has no harsh edges, so it doesn't suffer from strong
+                                    // aliasing at high pitches)
+        uint32_t tmp;
+        for (i = 0; i < samples; i++) {
+            tmp     = phase[i] ^ ringMSB;
+            wave[i] = (tmp ^ (tmp & 0x800000 ? 0xFFFFFF : 0)) >> 7;
+        }
     }
-    // update readable SID1-registers (some SID tunes might use 3rd channel ENV3/OSC3 value as control)
-    if (num == 0 && memory[1] & 3) {
-        sReg[0x1B] = wfout >> 8;
-        sReg[0x1C] = envcnt[3];
-    }  // OSC3, ENV3 (some players rely on it)
 
-    // FILTER: two integrator loop bi-quadratic filter, workings learned from resid code, but I kindof simplified the
-    // equations The phases of lowpass and highpass outputs are inverted compared to the input, but bandpass IS in phase
-    // with the input signal. The 8580 cutoff frequency control-curve is ideal (binary-weighted resistor-ladder VCRs),
-    // while the 6581 has a treshold, and below that it outputs a constant ~200Hz cutoff frequency. (6581 uses MOSFETs
-    // as VCRs to control cutoff causing nonlinearity and some 'distortion' due to resistance-modulation. There's a
-    // cca. 1.53Mohm resistor in parallel with the MOSFET in 6581 which doesn't let the frequency go below 200..220Hz
-    // Even if the MOSFET doesn't conduct at all. 470pF capacitors are small, so 6581 can't go below this
-    // cutoff-frequency with 1.5MOhm.)
-    cutoff[num] = sReg[0x16] * 8 + (sReg[0x15] & 0x07);  // 11-bit frequency control 0-2048 at ~6.1 Hz / inc
-    if (SID_model[num] == 8580) {
-        cutoff[num] = (1 - fast_exp(((cutoff[num]) + 2) * CUTOFF_RATIO_8580));  // linear curve by resistor-ladder VCR
-        // resonance[num] = ( powf(2, ((4 - (sReg[0x17] >> 4)) / 8.0)) );
-        resonance[num] = resonance_table[sReg[0x17] >> 4];
-    } else {  // 6581
-        cutoff[num] +=
-            round(filtin * FILTER_DISTORTION_6581);  // MOSFET-VCR control-voltage-modulation (resistance-modulation aka
-                                                     // 6581 filter distortion) emulation
-        rDS_VCR_FET =
-            cutoff[num] <= VCR_FET_TRESHOLD
-                ? 100000000.0  // below Vth treshold Vgs control-voltage FET presents an open circuit
-                : cutoff_steepness_6581 /
-                      (cutoff[num] -
-                       VCR_FET_TRESHOLD);  // rDS ~ (-Vth*rDSon) / (Vgs-Vth)  //above Vth FET drain-source resistance is
-                                           // proportional to reciprocal of cutoff-control voltage
-        cutoff[num] =
-            (1 - fast_exp(cap_6581_reciprocal / (VCR_SHUNT_6581 * rDS_VCR_FET / (VCR_SHUNT_6581 + rDS_VCR_FET)) /
-                          DEFAULT_SAMPLERATE));  // curve with 1.5MOhm VCR parallel Rshunt emulation
-        resonance[num] = ((sReg[0x17] > 0x5F) ? 8.0 / (sReg[0x17] >> 4) : 1.41);
-    }
-    filtout = 0;
-    ftmp     = filtin + prevbandpass[num] * resonance[num] + prevlowpass[num];
-    if (sReg[0x18] & (HIGHPASS_BITMASK | BANDPASS_BITMASK)) {
-        filtout -= ftmp;
+    // emulate waveform 00 floating wave-DAC (on real SID waveform00 decays after 15s..50s depending on temperature?)
+    // (So the decay is not an exact value. Anyway, we just simply keep the value to avoid clicks and support
+    // SounDemon digi later...) A voice held at zero leaves the DAC value alone as well.
+    if (wf && audible >= 0) {
+        prevwfout[channel] = wave[audible] & 0xFFFF;
     }
-    ftmp              = prevbandpass[num] - ftmp * cutoff[num];
-    prevbandpass[num] = ftmp;
-    if (sReg[0x18] & BANDPASS_BITMASK) {
-        filtout -= ftmp;
+    if (mix && audible >= 0) {
+        if (wf) {
+            for (i = 0; i < samples; i++) mix[i] += ((int)(wave[i] & 0xFFFF) - 0x8000) * env[i] / 256;
+        } else {
+            for (i = 0; i < samples; i++) mix[i] += ((int)prevwfout[channel] - 0x8000) * env[i] / 256;
+        }
     }
-    // ftmp             = (prevlowpass[num] << 1)  + ftmp * cutoff[num];
-    ftmp = (1-cutoff[num]) * (ftmp - prevlowpass[num]);
-    prevlowpass[num] = ftmp;
-    if (sReg[0x18] & LOWPASS_BITMASK) {
-        filtout += ftmp;
+    phaseaccu[channel] = accu;
+    prevaccu[channel]  = accu;
+    sourceMSB[num]     = accu & 0x800000;
+}
+
+// FILTER: two integrator loop bi-quadratic filter, workings learned from resid code, but I kindof simplified the
+// equations The phases of lowpass and highpass outputs are inverted compared to the input, but bandpass IS in phase
+// with the input signal. The 8580 cutoff frequency control-curve is ideal (binary-weighted resistor-ladder VCRs),
+// while the 6581 has a treshold, and below that it outputs a constant ~200Hz cutoff frequency. (6581 uses MOSFETs
+// as VCRs to control cutoff causing nonlinearity and some 'distortion' due to resistance-modulation. There's a
+// cca. 1.53Mohm resistor in parallel with the MOSFET in 6581 which doesn't let the frequency go below 200..220Hz
+// Even if the MOSFET doesn't conduct at all. 470pF capacitors are small, so 6581 can't go below this
+// cutoff-frequency with 1.5MOhm.)
+void SID::renderFilter(uint8_t num, const byte* sReg, int16_t* out, uint16_t samples)
+{
+    const byte  mode        = sReg[0x18];
+    const float cutoff_ctrl = sReg[0x16] * 8 + (sReg[0x15] & 0x07);  // 11-bit frequency control 0-2048 at ~6.1 Hz / inc
+    const bool  is8580      = (SID_model[num] == 8580);
+    float       cutoff = cutoff_ctrl, resonance, rDS_VCR_FET, ftmp;
+    int32_t     bandpass = prevbandpass[num], lowpass = prevlowpass[num];
+    int32_t     filtin, filtout, output;
+
+    if (is8580) {
+        cutoff = (1 - fast_exp(((cutoff) + 2) * cutoff_ratio_8580));  // linear curve by resistor-ladder VCR
+        // resonance = ( powf(2, ((4 - (sReg[0x17] >> 4)) / 8.0)) );
+        resonance = resonance_table[sReg[0x17] >> 4];
+    } else {  // 6581
+        resonance = ((sReg[0x17] > 0x5F) ? 8.0 / (sReg[0x17] >> 4) : 1.41);
     }
+    for (uint16_t i = 0; i < samples; i++) {
+        filtin = block_filtin[i];
+        if (!is8580) {
+            cutoff  = cutoff_ctrl;
+            cutoff += round(filtin * FILTER_DISTORTION_6581);  // MOSFET-VCR control-voltage-modulation (resistance-
+                                                               // modulation aka 6581 filter distortion) emulation
+            rDS_VCR_FET =
+                cutoff <= VCR_FET_TRESHOLD
+                    ? 100000000.0  // below Vth treshold Vgs control-voltage FET presents an open circuit
+                    : cutoff_steepness_6581 /
+                          (cutoff - VCR_FET_TRESHOLD);  // rDS ~ (-Vth*rDSon) / (Vgs-Vth)  //above Vth FET
+                                                        // drain-source resistance is proportional to reciprocal of
+                                                        // cutoff-control voltage
+            cutoff =
+                (1 - fast_exp(cap_6581_reciprocal / (VCR_SHUNT_6581 * rDS_VCR_FET / (VCR_SHUNT_6581 + rDS_VCR_FET)) /
+                              samplerate));  // curve with 1.5MOhm VCR parallel Rshunt emulation
+        }
+        filtout = 0;
+        ftmp    = filtin + bandpass * resonance + lowpass;
+        if (mode & (HIGHPASS_BITMASK | BANDPASS_BITMASK)) {
+            filtout -= ftmp;
+        }
+        ftmp     = bandpass - ftmp * cutoff;
+        bandpass = ftmp;
+        if (mode & BANDPASS_BITMASK) {
+            filtout -= ftmp;
+        }
+        ftmp    = (1 - cutoff) * (ftmp - lowpass);
+        lowpass = ftmp;
+        if (mode & LOWPASS_BITMASK) {
+            filtout += ftmp;
+        }
 
-    // output stage for one SID
-    // when it comes to $D418 volume-register digi playback, I made an AC / DC separation for $D418 value in the SwinSID
-    // at low (20Hz or so) cutoff-frequency, and sent the AC (highpass) value to a 4th 'digi' channel mixed to the
-    // master output, and set ONLY the DC (lowpass) value to the volume-control. This solved 2 issues: Thanks to the
-    // lowpass filtering of the volume-control, SID tunes where digi is played together with normal SID channels, won't
-    // sound distorted anymore, and the volume-clicks disappear when setting SID-volume. (This is useful for fade-in/out
-    // tunes like Hades Nebula, where clicking ruins the intro.)
-    output = (nonfilt + filtout) * (sReg[0x18] & 0xF) / OUTPUT_SCALEDOWN;
-    if (output >= 32767)
-        output = 32767;
-    else if (output <= -32768)
-        output = -32768;  // saturation logic on overload (not
-    // needed if the callback handles it)
-    return (int)output;  // master output
+        // output stage for one SID
+        // when it comes to $D418 volume-register digi playback, I made an AC / DC separation for $D418 value in the
+        // SwinSID at low (20Hz or so) cutoff-frequency, and sent the AC (highpass) value to a 4th 'digi' channel mixed
+        // to the master output, and set ONLY the DC (lowpass) value to the volume-control. This solved 2 issues:
+        // Thanks to the lowpass filtering of the volume-control, SID tunes where digi is played together with normal
+        // SID channels, won't sound distorted anymore, and the volume-clicks disappear when setting SID-volume. (This
+        // is useful for fade-in/out tunes like Hades Nebula, where clicking ruins the intro.)
+        output = (block_nonfilt[i] + filtout) * (mode & 0xF) / OUTPUT_SCALEDOWN;
+        if (output >= 32767)
+            output = 32767;
+        else if (output <= -32768)
+            output = -32768;  // saturation logic on overload
+        out[i] = output;      // master output
+    }
+    prevbandpass[num] = bandpass;
+    prevlowpass[num]  = lowpass;
 }
 
 // The anatomy of combined waveforms: The resid source simply uses 4kbyte 8bit samples from wavetable arrays, says these
@@ -486,12 +757,11 @@ int SID::cycle(unsigned char num,
 // in case you don't like these calculated combined waveforms it's easy to substitute the generated tables by
 // pre-sampled 'exact' versions
 
-int32_t SID::combinedWF(uint8_t num, uint8_t channel, const uint32_t* wfarray, int index, char differ6581,
+int32_t SID::combinedWF(uint8_t num, uint8_t channel, const uint16_t* wfarray, int index, char differ6581,
                         uint8_t freqh)
 {
-    static float addf;
     if (freqh == 0) freqh = 1;  // avoid division by zero
-    addf = 0.4 + 0.6 / freqh;
+    float addf = 0.4 + 0.6 / freqh;
     if (differ6581 && SID_model[num] == 6581) index &= 0x7FF;
     prevwavdata[channel] = wfarray[index] * addf + prevwavdata[channel] * (1.0 - addf);
     return prevwavdata[channel];
@@ -1,6 +1,7 @@
 #pragma once
 
 // global constants and variables
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include "../Config.hpp"
@@ -33,11 +34,11 @@ typedef void (*AudioCallback)(int16_t* samples, size_t num_samples);
 #define FILTER_DISTORTION_6581 \
     0.0016  // the bigger the value the more of resistance-modulation (filter
             // distortion) is applied for 6581 cutoff-control
-#define SAMPLES_PER_SCAN_LINE 63 / (CLOCK_RATIO_DEFAULT)
+#define CUTOFF_RATIO_8580_HZ  (-2 * 3.14 * (12500.0 / 2048))  // 12500.0 / 2048 ~= 6 Hz / inc, divided by the samplerate
 
 #define SAMPLE_BUFFER_SIZE 32
-#define CUTOFF_RATIO_8580  (-2 * 3.14 * (12500.0 / 2048) / DEFAULT_SAMPLERATE)  // 12500.0 / 2048 ~= 6 Hz / inc
-#define CLOCK_RATIO        (C64_PAL_CPUCLK / DEFAULT_SAMPLERATE)
+#define SID_BLOCK_SIZE     32    // max samples rendered per voice pass
+#define SID_REG_AMOUNT     0x19  // write-only registers that affect the output
 
 // raw output divided by this after multiplied by main volume, this also
 //  compensates for filter-resonance emphasis to avoid distortion
@@ -71,13 +72,39 @@ class SID {
     uint32_t      prevwfout[9], prevwavdata[9], sourceMSB[3], noise_LFSR[9];
     int32_t       phaseaccu[9], prevaccu[9], prevlowpass[3], prevbandpass[3];
     float         ratecnt[9], cutoff_steepness_6581, cap_6581_reciprocal;
-    float         clock_ratio = CLOCK_RATIO_DEFAULT;
+    // samplerate dependent values, see setSampleRate()
+    double        samplerate        = DEFAULT_SAMPLERATE;
+    double        clock_ratio       = CLOCK_RATIO_DEFAULT;  // C64 cycles per sample
+    uint32_t      accu_ratio        = (CLOCK_RATIO_DEFAULT) * 256;  // 24.8 fixed point, for exact oscillator pitch
+    double        cutoff_ratio_8580 = CUTOFF_RATIO_8580_HZ / DEFAULT_SAMPLERATE;
+    float         samples_per_line  = 63 / (CLOCK_RATIO_DEFAULT);
+    std::atomic<uint32_t> requested_samplerate{0};
     uint8_t*      memory;
     float         scan_line_sync = 0.0;
     AudioCallback audio_callback = nullptr;
 
-    int32_t combinedWF(uint8_t num, uint8_t channel, const uint32_t* wfarray, int index, char differ6581,
+    // per-block scratch, one entry per sample of the block being rendered
+    int32_t  block_filtin[SID_BLOCK_SIZE], block_nonfilt[SID_BLOCK_SIZE];
+    uint32_t block_phase[SID_BLOCK_SIZE], block_wave[SID_BLOCK_SIZE];
+    int16_t  block_env[SID_BLOCK_SIZE];
+    // register image and sample count of the lines not rendered yet
+    uint8_t  pending_regs[SID_REG_AMOUNT] = {};
+    uint16_t pending_samples              = 0;
+
+    int32_t combinedWF(uint8_t num, uint8_t channel, const uint16_t* wfarray, int index, char differ6581,
                        uint8_t freqh);
+    void    renderVoice(uint8_t num, uint8_t channel, const uint8_t* vReg, const uint8_t* sReg, uint16_t pos,
+                        uint16_t samples);
+    void    renderFilter(uint8_t num, const uint8_t* sReg, int16_t* out, uint16_t samples);
+    void    updateReadableRegs(unsigned char num, uint32_t baseaddr);
+    void    flush();
+
+    // silent-chip fast path (all voices released to zero, filter settled)
+    bool isSilent(unsigned char num, const uint8_t* sReg);
+    void skipSilent(unsigned char num, const uint8_t* sReg, uint16_t samples);
+    void clockSilentEnvelope(uint8_t channel, uint8_t SR);
+    void clockNoise(uint8_t channel, uint32_t clocks);
+    void emitSamples(int16_t value, uint16_t samples);
 
     // callback function to send out audio sample data
     // consists of a pointer and a number of samples to send
@@ -87,5 +114,14 @@ class SID {
     void cSID_init();
     void init(uint8_t* memory, AudioCallback sample_out_callback = nullptr, int sid_model = 8580);
     void raster_line();
+    // render the lines collected by raster_line() and send out the partly filled buffer, e.g. at the end of a render
+    void drain();
+    // change the samplerate, takes effect at the next raster line (may be called from another task)
+    void     requestSampleRate(uint32_t rate) { requested_samplerate = rate; }
+    uint32_t getSampleRate() const { return samplerate; }
+    // change the samplerate right away, only from the task that renders
+    void     setSampleRate(uint32_t rate);
+    // render samples from a register image without touching the audio buffer
+    void render(unsigned char num, const uint8_t* sReg, int16_t* out, uint16_t samples);
     int  cycle(unsigned char num, uint32_t baseaddr);
 };
\ No newline at end of file
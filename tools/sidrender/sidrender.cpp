@@ -0,0 +1,287 @@
+// sidrender - render a SID register-write log on the host with the emulator's SID code
+//
+// Reads a log of register writes, renders it to 16-bit mono audio, reports the render speed and optionally writes a
+// WAV file and/or compares the result against a golden WAV. See the README for the log format.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "sid/sid.hpp"
+
+struct RegWrite {
+    uint64_t cycle;
+    uint8_t  reg;
+    uint8_t  value;
+};
+
+static std::vector<int16_t> rendered;
+
+static void collectSamples(int16_t* samples, size_t num_samples)
+{
+    rendered.insert(rendered.end(), samples, samples + num_samples);
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: sidrender [options] <log>\n"
+            "  -o <file.wav>   write the rendered audio\n"
+            "  -g <file.wav>   compare against a golden WAV, exit code 1 on mismatch\n"
+            "  -t <n>          allowed difference per sample for -g (default 0)\n"
+            "  -r <rate>       samplerate in Hz (default 22050)\n"
+            "  -m <model>      SID model, 6581 or 8580 (default 8580)\n"
+            "  -x <seconds>    keep rendering after the last write (default 1.0)\n"
+            "  -n <count>      render this many times and report the best speed (default 1)\n"
+            "  -l              render per raster line like the emulator, instead of per sample via SID::cycle\n");
+    exit(2);
+}
+
+// Log lines: "<cycle> <register> <value>", numbers in C notation (decimal, 0x.. hex), '#' starts a comment
+static bool readLog(const char* path, std::vector<RegWrite>& writes)
+{
+    FILE* fp = fopen(path, "r");
+    char  line[256];
+    int   lineno = 0;
+
+    if (fp == nullptr) {
+        perror(path);
+        return false;
+    }
+    while (fgets(line, sizeof(line), fp) != nullptr) {
+        char* hash = strchr(line, '#');
+        char* end;
+        lineno++;
+        if (hash != nullptr) *hash = 0;
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
+
+        RegWrite w;
+        w.cycle            = strtoull(line, &end, 0);
+        unsigned long reg  = strtoul(end, &end, 0);
+        unsigned long val  = strtoul(end, &end, 0);
+        if (strspn(end, " \t\r\n") != strlen(end) || reg >= SID_REG_AMOUNT || val > 0xFF ||
+            (!writes.empty() && w.cycle < writes.back().cycle)) {
+            fprintf(stderr, "%s:%d: bad or out of order write\n", path, lineno);
+            fclose(fp);
+            return false;
+        }
+        w.reg   = reg;
+        w.value = val;
+        writes.push_back(w);
+    }
+    fclose(fp);
+    return true;
+}
+
+static void put16(FILE* fp, uint16_t v)
+{
+    fputc(v & 0xFF, fp);
+    fputc(v >> 8, fp);
+}
+
+static void put32(FILE* fp, uint32_t v)
+{
+    put16(fp, v & 0xFFFF);
+    put16(fp, v >> 16);
+}
+
+static bool writeWav(const char* path, const std::vector<int16_t>& samples, uint32_t rate)
+{
+    FILE*    fp = fopen(path, "wb");
+    uint32_t bytes = samples.size() * 2;
+
+    if (fp == nullptr) {
+        perror(path);
+        return false;
+    }
+    fwrite("RIFF", 1, 4, fp);
+    put32(fp, 36 + bytes);
+    fwrite("WAVEfmt ", 1, 8, fp);
+    put32(fp, 16);
+    put16(fp, 1);  // PCM
+    put16(fp, 1);  // mono
+    put32(fp, rate);
+    put32(fp, rate * 2);
+    put16(fp, 2);
+    put16(fp, 16);
+    fwrite("data", 1, 4, fp);
+    put32(fp, bytes);
+    for (size_t i = 0; i < samples.size(); i++) {
+        put16(fp, (uint16_t)samples[i]);
+    }
+    fclose(fp);
+    return true;
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Only what writeWav() produces is supported: 16-bit mono PCM
+static bool readWav(const char* path, std::vector<int16_t>& samples, uint32_t& rate)
+{
+    FILE*                fp = fopen(path, "rb");
+    std::vector<uint8_t> data;
+    uint8_t              buf[4096];
+    size_t               n, pos = 12;
+    bool                 fmtOk = false;
+
+    if (fp == nullptr) {
+        perror(path);
+        return false;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(fp);
+    if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) != 0 || memcmp(&data[8], "WAVE", 4) != 0) {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        return false;
+    }
+    while (pos + 8 <= data.size()) {
+        uint32_t size = get32(&data[pos + 4]);
+        if (pos + 8 + size > data.size()) break;
+        if (memcmp(&data[pos], "fmt ", 4) == 0 && size >= 16) {
+            const uint8_t* f = &data[pos + 8];
+            fmtOk            = (f[0] | (f[1] << 8)) == 1 && (f[2] | (f[3] << 8)) == 1 && (f[14] | (f[15] << 8)) == 16;
+            rate             = get32(&f[4]);
+        } else if (memcmp(&data[pos], "data", 4) == 0 && fmtOk) {
+            samples.resize(size / 2);
+            for (size_t i = 0; i < samples.size(); i++) {
+                samples[i] = (int16_t)(data[pos + 8 + i * 2] | (data[pos + 9 + i * 2] << 8));
+            }
+            return true;
+        }
+        pos += 8 + size + (size & 1);
+    }
+    fprintf(stderr, "%s: no 16-bit mono PCM data found\n", path);
+    return false;
+}
+
+// Render per sample: before every sample, apply the writes that happened up to that point in time
+static void renderCycle(SID& sid, uint8_t* regs, const std::vector<RegWrite>& writes, uint64_t endCycle)
+{
+    double clockRatio = C64_PAL_CPUCLK / sid.getSampleRate();
+    double now        = 0;
+    size_t next       = 0;
+
+    rendered.reserve(endCycle / clockRatio + 1);
+    for (; now < endCycle; now += clockRatio) {
+        while (next < writes.size() && writes[next].cycle <= now) {
+            regs[writes[next].reg] = writes[next].value;
+            next++;
+        }
+        rendered.push_back(sid.cycle(0, 0x0000));
+    }
+}
+
+// Render like the emulator: registers as they are at the end of each raster line of 63 cycles
+static void renderRaster(SID& sid, uint8_t* regs, const std::vector<RegWrite>& writes, uint64_t endCycle)
+{
+    size_t next = 0;
+
+    for (uint64_t lineEnd = 63; lineEnd - 63 < endCycle; lineEnd += 63) {
+        while (next < writes.size() && writes[next].cycle < lineEnd) {
+            regs[writes[next].reg] = writes[next].value;
+            next++;
+        }
+        sid.raster_line();
+    }
+    // the last lines are still collected and the output buffer is partly filled
+    sid.drain();
+}
+
+int main(int argc, char** argv)
+{
+    const char* outPath    = nullptr;
+    const char* goldenPath = nullptr;
+    int         tolerance  = 0;
+    uint32_t    rate       = DEFAULT_SAMPLERATE;
+    int         model      = SIDMODEL_8580;
+    double      tail       = 1.0;
+    int         runs       = 1;
+    bool        raster     = false;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "o:g:t:r:m:x:n:l")) != -1) {
+        switch (opt) {
+            case 'o': outPath = optarg; break;
+            case 'g': goldenPath = optarg; break;
+            case 't': tolerance = atoi(optarg); break;
+            case 'r': rate = atoi(optarg); break;
+            case 'm': model = atoi(optarg); break;
+            case 'x': tail = atof(optarg); break;
+            case 'n': runs = atoi(optarg); break;
+            case 'l': raster = true; break;
+            default: usage();
+        }
+    }
+    if (optind != argc - 1 || rate < 8000 || rate > 96000 || (model != SIDMODEL_6581 && model != SIDMODEL_8580) ||
+        runs < 1) {
+        usage();
+    }
+
+    std::vector<RegWrite> writes;
+    if (!readLog(argv[optind], writes)) {
+        return 2;
+    }
+    uint64_t endCycle = (writes.empty() ? 0 : writes.back().cycle) + (uint64_t)(tail * C64_PAL_CPUCLK);
+
+    double best = 0;
+    for (int run = 0; run < runs; run++) {
+        static uint8_t regs[0x100];
+        static SID     sid;
+        memset(regs, 0, sizeof(regs));
+        rendered.clear();
+        sid.init(regs, collectSamples, model);
+        sid.setSampleRate(rate);
+
+        auto start = std::chrono::steady_clock::now();
+        if (raster) {
+            renderRaster(sid, regs, writes, endCycle);
+        } else {
+            renderCycle(sid, regs, writes, endCycle);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || seconds < best) best = seconds;
+    }
+    printf("%zu writes, %zu samples at %u Hz (%.2f s of audio), rendered in %.3f s: %.0f samples/s, %.1fx realtime\n",
+           writes.size(), rendered.size(), rate, (double)rendered.size() / rate, best, rendered.size() / best,
+           rendered.size() / best / rate);
+
+    if (outPath != nullptr && !writeWav(outPath, rendered, rate)) {
+        return 2;
+    }
+    if (goldenPath != nullptr) {
+        std::vector<int16_t> golden;
+        uint32_t             goldenRate = 0;
+        size_t               differ = 0, first = 0;
+        int                  maxDiff = 0;
+
+        if (!readWav(goldenPath, golden, goldenRate)) {
+            return 2;
+        }
+        if (goldenRate != rate || golden.size() != rendered.size()) {
+            printf("golden mismatch: %zu samples at %u Hz, rendered %zu samples at %u Hz\n", golden.size(), goldenRate,
+                   rendered.size(), rate);
+            return 1;
+        }
+        for (size_t i = 0; i < golden.size(); i++) {
+            int diff = abs(golden[i] - rendered[i]);
+            if (diff > tolerance) {
+                if (differ++ == 0) first = i;
+            }
+            if (diff > maxDiff) maxDiff = diff;
+        }
+        if (differ != 0) {
+            printf("golden mismatch: %zu samples differ by more than %d, max difference %d, first at %zu (%.3f s)\n",
+                   differ, tolerance, maxDiff, first, (double)first / rate);
+            return 1;
+        }
+        printf("golden match (max difference %d)\n", maxDiff);
+    }
+    return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+// Host stand-in: memory placement attributes have no meaning off-device
+
+#define DRAM_ATTR
+#define IRAM_ATTR
@@ -0,0 +1,17 @@
+#pragma once
+// Host stand-in for the GPIO numbers Config.hpp refers to
+
+typedef enum {
+    GPIO_NUM_2  = 2,
+    GPIO_NUM_3  = 3,
+    GPIO_NUM_4  = 4,
+    GPIO_NUM_10 = 10,
+    GPIO_NUM_11 = 11,
+    GPIO_NUM_13 = 13,
+    GPIO_NUM_14 = 14,
+    GPIO_NUM_15 = 15,
+    GPIO_NUM_39 = 39,
+    GPIO_NUM_42 = 42,
+    GPIO_NUM_43 = 43,
+    GPIO_NUM_44 = 44,
+} gpio_num_t;